@@ -14,10 +14,27 @@ struct fncall
 
 struct cond
 {
+	// The test function, resolved by resolve_conditions once the file
+	// is parsed.
+	enum op_t { op_unresolved, op_else, op_config, op_config_choice, op_isempty, op_contains,
+		op_infile, op_exists, op_count, op_equals, op_unknown };
+
+	cond()
+		: invert(false), op(op_unresolved), number(0), compare('=')
+	{
+	}
+
 	bool invert;
 	fncall call;
+
+	op_t op;
+	std::vector<std::string> options; // sorted choices of op_config_choice
+	size_t number; // op_count
+	char compare; // op_count: '=', '<' or '>'
 };
 
+class regex_subst;
+
 struct stmt
 {
 	virtual ~stmt() {}
@@ -37,6 +54,10 @@ struct var_stmt
 	std::string name;
 	kind_t kind;
 	std::vector<std::string> ident_list;
+
+	// The last expression compiled for a k_regex statement, reused as long
+	// as the translated expression stays the same.
+	mutable std::shared_ptr<regex_subst const> compiled;
 };
 
 struct fncall_stmt
@@ -0,0 +1,261 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include "env.hpp"
+
+static char const baseline_magic[] = "qmake_parser baseline 2";
+
+static baseline_env::source stat_source(std::string const & path)
+{
+	boost::system::error_code ec;
+	baseline_env::source res;
+	res.path = path;
+	res.mtime = fs::last_write_time(path, ec);
+	if (ec)
+		res.mtime = -1;
+	res.size = fs::file_size(path, ec);
+	if (ec)
+		res.size = uintmax_t(-1);
+	return res;
+}
+
+static bool sources_unchanged(std::vector<baseline_env::source> const & sources)
+{
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		baseline_env::source cur = stat_source(sources[i].path);
+		if (cur.mtime != sources[i].mtime || cur.size != sources[i].size)
+			return false;
+	}
+	return true;
+}
+
+// Values are written one per line, with backslashes and newlines escaped.
+static std::string escape(std::string const & s)
+{
+	std::string res;
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		if (s[i] == '\\')
+			res.append("\\\\");
+		else if (s[i] == '\n')
+			res.append("\\n");
+		else
+			res.push_back(s[i]);
+	}
+	return res;
+}
+
+static std::string unescape(std::string const & s)
+{
+	std::string res;
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		if (s[i] == '\\' && i + 1 < s.size())
+			res.push_back(s[++i] == 'n'? '\n': s[i]);
+		else
+			res.push_back(s[i]);
+	}
+	return res;
+}
+
+static void save_baseline(std::string const & cache_file, baseline_env const & baseline)
+{
+	fs::path tmp = cache_file;
+	tmp += fs::unique_path(".%%%%%%%%.tmp");
+	{
+		std::ofstream fout(tmp.string().c_str(), std::ios::binary);
+		fout << baseline_magic << "\n";
+		fout << "spec " << escape(baseline.spec) << "\n";
+		fout << "inputs " << escape(baseline.inputs) << "\n";
+		for (size_t i = 0; i < baseline.sources.size(); ++i)
+		{
+			baseline_env::source const & src = baseline.sources[i];
+			fout << "source " << (long long)src.mtime << " " << (long long)src.size << " " << escape(src.path) << "\n";
+		}
+		for (auto it = baseline.env_vars.begin(); it != baseline.env_vars.end(); ++it)
+			fout << "getenv " << escape(it->first) << "=" << escape(it->second) << "\n";
+		for (size_t i = 0; i < baseline.post_files.size(); ++i)
+			fout << "post " << escape(baseline.post_files[i]) << "\n";
+		for (auto it = baseline.env.begin(); it != baseline.env.end(); ++it)
+		{
+			fout << "var " << escape(it->first) << "\n";
+			for (size_t i = 0; i < it->second->size(); ++i)
+				fout << "value " << escape((*it->second)[i]) << "\n";
+		}
+		fout << "end\n";
+
+		if (!fout)
+			throw std::runtime_error("Cannot write baseline cache: " + cache_file);
+	}
+
+	boost::system::error_code ec;
+	fs::rename(tmp, cache_file, ec);
+	if (ec)
+	{
+		fs::remove(tmp, ec);
+		throw std::runtime_error("Cannot write baseline cache: " + cache_file);
+	}
+}
+
+// Returns nullptr if the file is missing, malformed or out of date.
+static std::shared_ptr<baseline_env> load_baseline(std::string const & cache_file, std::string const & spec, std::string const & inputs, eval_options const & opts)
+{
+	std::ifstream fin(cache_file.c_str(), std::ios::binary);
+	std::string line;
+	if (!std::getline(fin, line) || line != baseline_magic)
+		return nullptr;
+
+	std::shared_ptr<baseline_env> res = std::make_shared<baseline_env>();
+	std::map<std::string, value_ref> vars;
+	value_ref cur;
+	while (std::getline(fin, line))
+	{
+		size_t sp = line.find(' ');
+		std::string key = line.substr(0, sp);
+		std::string arg = sp == std::string::npos? std::string(): unescape(line.substr(sp + 1));
+
+		if (key == "end")
+		{
+			if (res->spec != spec || res->inputs != inputs || !sources_unchanged(res->sources))
+				return nullptr;
+
+			res->env = env_t(opts);
+			for (auto it = res->env_vars.begin(); it != res->env_vars.end(); ++it)
+			{
+				if (res->env.get_env_var(it->first) != it->second)
+					return nullptr;
+			}
+
+			for (auto it = vars.begin(); it != vars.end(); ++it)
+				res->env.set_values(it->first, it->second);
+			res->env.intern_values();
+			return res;
+		}
+		else if (key == "spec")
+			res->spec = arg;
+		else if (key == "inputs")
+			res->inputs = arg;
+		else if (key == "source")
+		{
+			baseline_env::source src;
+			long long mtime, size;
+			int path_pos = 0;
+			if (sscanf(line.c_str(), "source %lld %lld %n", &mtime, &size, &path_pos) != 2 || path_pos == 0)
+				return nullptr;
+			src.mtime = (std::time_t)mtime;
+			src.size = (uintmax_t)size;
+			src.path = unescape(line.substr(path_pos));
+			res->sources.push_back(src);
+		}
+		else if (key == "getenv")
+		{
+			// Variable names can't contain '='.
+			size_t eq = arg.find('=');
+			if (eq == std::string::npos)
+				return nullptr;
+			res->env_vars[arg.substr(0, eq)] = arg.substr(eq + 1);
+		}
+		else if (key == "post")
+			res->post_files.push_back(arg);
+		else if (key == "var")
+			cur = vars[arg] = std::make_shared<value_list>();
+		else if (key == "value" && cur)
+			cur->push_back(arg);
+		else
+			return nullptr;
+	}
+
+	// Truncated.
+	return nullptr;
+}
+
+std::shared_ptr<baseline_env const> make_baseline(std::string const & spec, eval_options const & opts, std::string const & cache_file)
+{
+	// The baseline is complete, whatever the roots end up reading.
+	eval_options base_opts = opts;
+	base_opts.slice = nullptr;
+	base_opts.baseline.reset();
+
+	std::string inputs = opts.inputs? opts.inputs->fingerprint(): std::string();
+	if (opts.qt)
+		inputs.append("\nq").append(opts.qt->fingerprint());
+	if (!cache_file.empty())
+	{
+		if (std::shared_ptr<baseline_env const> cached = load_baseline(cache_file, spec, inputs, base_opts))
+			return cached;
+	}
+
+	std::shared_ptr<baseline_env> res = std::make_shared<baseline_env>();
+	res->spec = spec;
+	res->inputs = inputs;
+
+	std::vector<std::string> pre_files;
+	if (!spec.empty())
+	{
+		// Features live next to the mkspecs, as in mkspecs/features.
+		fs::path spec_dir = fs::absolute(spec);
+		fs::path features = spec_dir.parent_path() / "features";
+
+		pre_files.push_back((spec_dir / "qmake.conf").string());
+		pre_files.push_back((features / "default_pre.prf").string());
+
+		std::string post = (features / "default_post.prf").string();
+		res->sources.push_back(stat_source(post));
+		if (res->sources.back().size != uintmax_t(-1))
+			res->post_files.push_back(post);
+	}
+
+	// Evaluated with a private cache, which then lists every file read and
+	// every path looked for.
+	eval_cache cache;
+	eval_options eval_opts = base_opts;
+	eval_opts.cache = &cache;
+	eval_opts.stream = false;
+	eval_opts.env_read = [&res](std::string const & name, std::string const & value) {
+		res->env_vars[name] = value;
+	};
+
+	env_t env(eval_opts);
+	init_root_env(env, eval_opts);
+	if (!spec.empty())
+		env.set_var("QMAKESPEC", fs::absolute(spec).string());
+	for (size_t i = 0; i < pre_files.size(); ++i)
+	{
+		if (!process_qmake_file(pre_files[i], env))
+		{
+			// The spec itself is required; default_pre.prf is optional.
+			if (i == 0)
+				throw std::runtime_error("Cannot read mkspec: " + pre_files[i]);
+			res->sources.push_back(stat_source(pre_files[i]));
+		}
+	}
+
+	if (opts.qt && !opts.qt->source().empty())
+		res->sources.push_back(stat_source(opts.qt->source()));
+
+	// Probed paths include optional features that are missing, e.g. for
+	// load(name, true); creating one must invalidate the cache.
+	std::set<std::string> seen;
+	for (size_t i = 0; i < res->sources.size(); ++i)
+		seen.insert(fs::path(res->sources[i].path).generic_string());
+
+	std::vector<std::string> read = cache.file_names();
+	std::vector<std::string> probed = cache.fs().probed();
+	read.insert(read.end(), probed.begin(), probed.end());
+	for (size_t i = 0; i < read.size(); ++i)
+	{
+		if (seen.insert(fs::path(read[i]).generic_string()).second)
+			res->sources.push_back(stat_source(read[i]));
+	}
+
+	// PWD only means something while a file is being evaluated.
+	env.unset_var("PWD");
+
+	res->env = env_t(env, base_opts);
+	res->env.intern_values();
+
+	if (!cache_file.empty())
+		save_baseline(cache_file, *res);
+	return res;
+}
@@ -2,14 +2,94 @@
 #define ENV_HPP
 
 #include "ast.hpp"
+#include "slice.hpp"
+#include "value_pool.hpp"
+#include "regex_subst.hpp"
+#include "fs_cache.hpp"
+#include "stats.hpp"
+#include "resolve.hpp"
+#include "eval_cache.hpp"
+#include "qt_props.hpp"
+#include <functional>
 #include <map>
+#include <iterator>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem; // XXX
 
 class env_t;
+struct baseline_env;
+
+// Values injected into an evaluation by whoever runs it.
+struct eval_inputs
+{
+	eval_inputs()
+		: inherit_environment(true)
+	{
+	}
+
+	// Appended to the default CONFIG of every root.
+	std::vector<std::string> config;
+
+	// $$(NAME) lookups; unless inherit_environment is cleared, names not
+	// listed here fall back to the process environment.
+	std::map<std::string, std::string> environment;
+	bool inherit_environment;
+
+	// Identifies the inputs in cache keys.
+	std::string fingerprint() const
+	{
+		std::string res;
+		res.append(inherit_environment? "+": "-");
+		for (size_t i = 0; i < config.size(); ++i)
+			res.append("\nc").append(config[i]);
+		for (auto it = environment.begin(); it != environment.end(); ++it)
+			res.append("\ne").append(it->first).append("=").append(it->second);
+		return res;
+	}
+};
+
+// Settings shared by every environment evaluated for a root project.
+struct eval_options
+{
+	eval_options()
+		: slice(nullptr), cache(nullptr), stream(false)
+	{
+	}
+
+	std::shared_ptr<eval_inputs const> inputs;
+
+	// The state roots start from instead of the default CONFIG, if set.
+	std::shared_ptr<baseline_env const> baseline;
+
+	// Answers $$[NAME] lookups and provides the Qt paths of generated
+	// projects; the built-in installation if not set. Injected properties
+	// are applied with qt_props::with_overrides.
+	std::shared_ptr<qt_props const> qt;
+
+	// Restricts evaluation to statements relevant to the output, if set.
+	slice_t * slice;
+
+	// Shares parsed files and infile() results between roots, if set.
+	eval_cache * cache;
+
+	// Evaluates top-level statements while the file is still being read
+	// instead of parsing the whole file first.
+	bool stream;
+
+	// Receives warnings about files as they are loaded, if set.
+	std::function<void (std::string const & msg)> warn;
+
+	// Receives every environment variable read and its value, if set.
+	std::function<void (std::string const & name, std::string const & value)> env_read;
+};
 
 bool process_qmake_file(std::string const & fname, env_t & env);
-env_t process_root_qmake_file(std::string const & fname);
+void init_root_env(env_t & env, eval_options const & opts);
+env_t process_root_qmake_file(std::string const & fname, eval_options const & opts = eval_options());
+std::shared_ptr<env_t const> process_infile_root(std::string const & fname, eval_options const & opts);
 
 struct process_context
 {
@@ -26,77 +106,161 @@ struct process_context
 class env_t
 {
 public:
-	typedef std::map<std::string, std::vector<std::string> >::const_iterator const_iterator;
+	typedef std::map<std::string, value_ref>::const_iterator const_iterator;
 	const_iterator begin() const { return vars.begin(); }
 	const_iterator end() const { return vars.end(); }
 
 	env_t()
+		: m_slice(nullptr), m_relevant_version(0)
+	{
+	}
+
+	explicit env_t(eval_options const & opts)
+		: m_opts(opts), m_slice(opts.slice), m_relevant_version(0)
+	{
+	}
+
+	// Starts out with the variables of `base`. The value lists are shared
+	// until one of the environments modifies them.
+	env_t(env_t const & base, eval_options const & opts)
+		: vars(base.vars), m_opts(opts), m_slice(opts.slice), m_relevant_version(0)
 	{
 	}
 
+	eval_options const & options() const { return m_opts; }
+
+	fs_cache & fs() const { return m_opts.cache? m_opts.cache->fs(): fs_cache::instance(); }
+
+	// Drops the cache, slice and callbacks from the options, so that
+	// the environment may outlive them once it is evaluated.
+	void detach()
+	{
+		m_opts.cache = nullptr;
+		m_opts.slice = nullptr;
+		m_opts.warn = nullptr;
+		m_opts.env_read = nullptr;
+		this->set_slice(nullptr);
+	}
+	slice_t * slice() const { return m_slice; }
+	void set_slice(slice_t * slice) { m_slice = slice; m_relevant.reset(); }
+
+	// Variables whose assignments were skipped because they were not
+	// relevant to the output at the time.
+	std::set<std::string> const & skipped_vars() const { return m_skipped; }
+
 	void process_stmt(process_context & ctx, stmt * s)
 	{
 		if (block_stmt * b = dynamic_cast<block_stmt *>(s))
 			process_block_stmt(ctx, b);
 		else if (var_stmt * b = dynamic_cast<var_stmt *>(s))
-			process_var_stmt(ctx, *b);
+		{
+			if (m_slice && this->relevant()->count(b->name) == 0)
+				m_skipped.insert(b->name);
+			else
+				process_var_stmt(ctx, *b);
+		}
 		else if (fncall_stmt * b = dynamic_cast<fncall_stmt *>(s))
 			process_fncall_stmt(ctx, *b);
 	}
 
 	void process_block_stmt(process_context & ctx, block_stmt * b)
 	{
-		bool last_enabled = false;
-		for (size_t i = 0; i < b->stmts.size(); ++i)
+		this->process_block_stmt(ctx, b, b->stmts.size(), false);
+	}
+
+	// Evaluates the first `count` statements of the block, continuing
+	// after a statement whose condition evaluated to `last_enabled`.
+	// Returns the outcome of the last condition, for a following `else`.
+	//
+	// The whole block is sliced with one snapshot of the relevant set.
+	// With a newer snapshot halfway through an else-chain, an `else` could
+	// become live after the statement before it was skipped, and would
+	// then test a stale outcome.
+	bool process_block_stmt(process_context & ctx, block_stmt * b, size_t count, bool last_enabled)
+	{
+		slice_t::snapshot_t relevant = m_slice? this->relevant(): nullptr;
+		for (size_t i = 0; i < count; ++i)
 		{
+			if (relevant && !slice_t::needs_condition(*relevant, *b, i))
+			{
+				slice_t::collect_assigned(b->stmts[i].s.get(), m_skipped);
+				continue;
+			}
+
 			last_enabled = check_condition(b->stmts[i].c, last_enabled);
 			if (last_enabled)
+			{
+				count_stat(stat_statements);
 				process_stmt(ctx, b->stmts[i].s.get());
+			}
 		}
+		return last_enabled;
 	}
 
 	void add_var(std::string const & name, std::string const & val)
 	{
-		vars[name].push_back(val);
+		this->modify_var(name).push_back(val);
 	}
 
 	void set_var(std::string const & name, std::string const & val)
 	{
-		auto & v = vars[name];
-		v.clear();
-		v.push_back(val);
+		count_stat(stat_var_writes);
+		vars[name] = std::make_shared<value_list>(1, val);
+	}
+
+	void set_values(std::string const & name, value_ref const & values)
+	{
+		count_stat(stat_var_writes);
+		vars[name] = values;
+	}
+
+	void unset_var(std::string const & name)
+	{
+		count_stat(stat_var_writes);
+		vars.erase(name);
+	}
+
+	// Replaces every value list with its interned counterpart, so that
+	// environments evaluated from the same .pri files share storage.
+	void intern_values()
+	{
+		value_pool & pool = value_pool::instance();
+		for (auto it = vars.begin(); it != vars.end(); ++it)
+			it->second = pool.intern(it->second);
 	}
 
 	void process_var_stmt(process_context & ctx, var_stmt const & s)
 	{
 		std::vector<std::string> processed_values;
+		processed_values.reserve(s.ident_list.size());
 		for (size_t i = 0; i < s.ident_list.size(); ++i)
-			processed_values.push_back(translate_value(s.ident_list[i]));
+			translate_values(s.ident_list[i], processed_values);
 
 		switch (s.kind)
 		{
 		case var_stmt::k_eq:
-			vars[s.name] = processed_values;
+			count_stat(stat_var_writes);
+			vars[s.name] = std::make_shared<value_list>(std::move(processed_values));
 			break;
 		case var_stmt::k_add:
 			{
-				std::vector<std::string> & val = vars[s.name];
-				val.insert(val.end(), processed_values.begin(), processed_values.end());
+				value_list & val = this->modify_var(s.name);
+				val.insert(val.end(), std::make_move_iterator(processed_values.begin()), std::make_move_iterator(processed_values.end()));
 			}
 			break;
 		case var_stmt::k_add_unique:
 			{
-				std::vector<std::string> & val = vars[s.name];
+				value_list & val = this->modify_var(s.name);
 				for (size_t i = 0; i < processed_values.size(); ++i)
 				{
-					if (std::find(val.begin(), val.end(), processed_values[i]) != val.end())
+					if (std::find(val.begin(), val.end(), processed_values[i]) == val.end())
 						val.push_back(processed_values[i]);
 				}
 			}
 			break;
 		case var_stmt::k_sub:
 			{
-				std::vector<std::string> & val = vars[s.name];
+				value_list & val = this->modify_var(s.name);
 				for (size_t i = 0; i < processed_values.size(); ++i)
 				{
 					auto it = std::find(val.begin(), val.end(), processed_values[i]);
@@ -105,7 +269,33 @@ public:
 				}
 			}
 			break;
+		case var_stmt::k_regex:
+			if (!processed_values.empty())
+			{
+				// Spaces in the expression split it into several values.
+				std::string expr = processed_values[0];
+				for (size_t i = 1; i < processed_values.size(); ++i)
+					expr.append(1, ' ').append(processed_values[i]);
+
+				std::shared_ptr<regex_subst const> re = compile_subst(s, expr);
+				value_list & val = this->modify_var(s.name);
+				for (size_t i = 0; i < val.size(); ++i)
+					re->apply(val[i]);
+			}
+			break;
+		}
+	}
+
+	static std::shared_ptr<regex_subst const> compile_subst(var_stmt const & s, std::string const & expr)
+	{
+		// The AST may be shared between threads, hence the atomic accesses.
+		std::shared_ptr<regex_subst const> re = std::atomic_load(&s.compiled);
+		if (!re || re->source() != expr)
+		{
+			re = regex_subst::compile(expr);
+			std::atomic_store(&s.compiled, re);
 		}
+		return re;
 	}
 
 	void process_fncall_stmt(process_context & ctx, fncall_stmt const & b)
@@ -114,6 +304,11 @@ public:
 		{
 			process_qmake_file(fs::absolute(this->translate_value(b.call.args[0]), ctx.dir).string(), *this);
 		}
+		else if (b.call.fn == "load" && (b.call.args.size() == 1 || b.call.args.size() == 2))
+		{
+			bool ignore_missing = b.call.args.size() == 2 && this->translate_value(b.call.args[1]) == "true";
+			this->load_feature(this->translate_value(b.call.args[0]), ignore_missing);
+		}
 		else
 		{
 			throw std::runtime_error("Unkonwn function call: " + b.call.fn);
@@ -122,16 +317,19 @@ public:
 
 	std::vector<std::string> const * get(std::string const & name) const
 	{
+		count_stat(stat_var_reads);
 		auto it = vars.find(name);
-		return it == vars.end()? nullptr: &it->second;
+		return it == vars.end()? nullptr: it->second.get();
 	}
 
-	std::vector<std::string> get_many(std::string const & name) const
+	std::vector<std::string> const & get_many(std::string const & name) const
 	{
+		static std::vector<std::string> const empty;
+		count_stat(stat_var_reads);
 		auto it = vars.find(name);
 		if (it == vars.end())
-			return std::vector<std::string>();
-		return it->second;
+			return empty;
+		return *it->second;
 	}
 
 	std::string get_one(std::string const & name) const
@@ -159,6 +357,9 @@ public:
 
 		std::string const * begin() const { return first; }
 		std::string const * end() const { return last; }
+		size_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+		std::string const & operator[](size_t i) const { return first[i]; }
 
 		operator std::vector<std::string>() const
 		{
@@ -168,7 +369,6 @@ public:
 
 	vector_iter get_var_many(std::string const & name) const
 	{
-		std::string res;
 		std::vector<std::string> const * v = this->get(name);
 		if (!v)
 			return vector_iter();
@@ -178,34 +378,78 @@ public:
 	std::string get_var(std::string const & name) const
 	{
 		std::string res;
+		this->append_var(res, name);
+		return res;
+	}
+
+	// Appends the space-joined value of the variable directly to `res`,
+	// so that expansions don't materialize a temporary joined string.
+	void append_var(std::string & res, std::string const & name) const
+	{
 		std::vector<std::string> const * v = this->get(name);
-		if (!v)
-			return res;
+		if (!v || v->empty())
+			return;
+
+		size_t len = v->size() - 1;
+		for (size_t i = 0; i < v->size(); ++i)
+			len += (*v)[i].size();
+		res.reserve(res.size() + len);
+
 		for (size_t i = 0; i < v->size(); ++i)
 		{
 			if (i != 0)
 				res.append(1, ' ');
 			res.append((*v)[i]);
 		}
-		return res;
 	}
 
 	std::string get_env_var(std::string const & name) const
 	{
-		return getenv(name.c_str());
+		std::string res;
+		if (eval_inputs const * inputs = m_opts.inputs.get())
+		{
+			auto it = inputs->environment.find(name);
+			if (it != inputs->environment.end())
+				res = it->second;
+			else if (inputs->inherit_environment)
+				res = get_process_env_var(name);
+		}
+		else
+		{
+			res = get_process_env_var(name);
+		}
+
+		if (m_opts.env_read)
+			m_opts.env_read(name, res);
+		return res;
+	}
+
+	static std::string get_process_env_var(std::string const & name)
+	{
+		char const * value = getenv(name.c_str());
+		return value? value: std::string();
 	}
 
 	std::string get_prop(std::string const & name) const
 	{
-		if (name == "QT_INSTALL_HEADER")
-			return "c:\\QtSDK\\Desktop\\Qt\\4.8.1\\msvc2010\\include";
-		if (name == "QT_INSTALL_LIB")
-			return "c:\\QtSDK\\Desktop\\Qt\\4.8.1\\msvc2010\\lib";
-		return "";
+		std::string const * value = this->qt().find(name);
+		return value? *value: std::string();
+	}
+
+	qt_props const & qt() const
+	{
+		return m_opts.qt? *m_opts.qt: *qt_props::builtin();
 	}
 
 	std::string translate_value(std::string const & s) const
 	{
+		count_stat(stat_translate_calls);
+		if (s.find('$') == std::string::npos)
+		{
+			count_stat(stat_translate_bytes, s.size());
+			return s;
+		}
+
 		std::string res;
 		res.reserve(s.size());
 
@@ -248,6 +492,33 @@ public:
 						state = *cur == '{'? st_brace: *cur == '['? st_bracket: st_paren;
 						++cur;
 					}
+					else if (*cur == '(')
+					{
+						// An unterminated call is kept as written.
+						char const * close = find_call_end(cur, last);
+						if (!close)
+						{
+							state = st_idle;
+							break;
+						}
+
+						value_list values;
+						if (this->call_replace_function(std::string(first, cur), split_args(cur + 1, close), values))
+						{
+							for (size_t i = 0; i < values.size(); ++i)
+							{
+								if (i != 0)
+									res.append(1, ' ');
+								res.append(values[i]);
+							}
+							last_store = close + 1;
+						}
+
+						// Unsupported functions are kept as written; unknown
+						// ones are reported when the file is loaded.
+						cur = close + 1;
+						state = st_idle;
+					}
 					else
 						state = st_idle;
 				}
@@ -259,7 +530,7 @@ public:
 				{
 					if (first != cur)
 					{
-						res.append(this->get_var(std::string(first, cur)));
+						this->append_var(res, std::string(first, cur));
 						last_store = cur;
 					}
 					state = st_idle;
@@ -273,12 +544,11 @@ public:
 					std::string tmp(first + 1, cur);
 					switch (state)
 					{
-					case st_brace: tmp = this->get_var(tmp); break;
-					case st_bracket: tmp = this->get_prop(tmp); break;
-					case st_paren: tmp = this->get_env_var(tmp); break;
+					case st_brace: this->append_var(res, tmp); break;
+					case st_bracket: res.append(this->get_prop(tmp)); break;
+					case st_paren: res.append(this->get_env_var(tmp)); break;
 					}
 
-					res.append(tmp);
 					last_store = cur + 1;
 					state = st_idle;
 				}
@@ -288,27 +558,291 @@ public:
 		}
 
 		if (state == st_dollardollar && first != cur)
-			res.append(this->get_var(std::string(first, last)));
+			this->append_var(res, std::string(first, last));
 		else
-			res.append(std::string(last_store, last));
+			res.append(last_store, last);
 
+		count_stat(stat_translate_bytes, res.size());
 		return res;
 	}
 
+	// Translates a single list item. An item consisting solely of a replace
+	// function call contributes each of the function's values separately.
+	void translate_values(std::string const & s, value_list & out) const
+	{
+		if (s.size() > 2 && s[0] == '$' && s[1] == '$')
+		{
+			char const * first = s.data() + 2;
+			char const * last = s.data() + s.size();
+			char const * cur = first;
+			while (cur != last && (isalnum((unsigned char)*cur) || *cur == '_'))
+				++cur;
+
+			if (cur != first && cur != last && *cur == '(' && find_call_end(cur, last) == last - 1)
+			{
+				value_list values;
+				if (this->call_replace_function(std::string(first, cur), split_args(cur + 1, last - 1), values))
+				{
+					out.insert(out.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+					return;
+				}
+			}
+		}
+
+		out.push_back(this->translate_value(s));
+	}
+
+	// Returns false, leaving `res` empty, for functions that aren't
+	// supported or are called with the wrong number of arguments.
+	bool call_replace_function(std::string const & fn, std::vector<std::string> const & args, value_list & res) const
+	{
+		if (fn == "files" && (args.size() == 1 || args.size() == 2))
+		{
+			this->glob_files(args[0], args.size() == 2 && args[1] == "true", res);
+		}
+		else if (fn == "join" && args.size() >= 1 && args.size() <= 4)
+		{
+			value_list const & values = this->get_many(args[0]);
+			if (!values.empty())
+			{
+				std::string joined = args.size() > 2? args[2]: std::string();
+				for (size_t i = 0; i < values.size(); ++i)
+				{
+					if (i != 0 && args.size() > 1)
+						joined.append(args[1]);
+					joined.append(values[i]);
+				}
+				if (args.size() > 3)
+					joined.append(args[3]);
+				res.push_back(joined);
+			}
+		}
+		else if (fn == "split" && (args.size() == 1 || args.size() == 2))
+		{
+			value_list const & values = this->get_many(args[0]);
+			std::string const sep = args.size() > 1? args[1]: " ";
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				size_t start = 0;
+				for (;;)
+				{
+					size_t pos = sep.empty()? std::string::npos: values[i].find(sep, start);
+					if (pos != start)
+						res.push_back(values[i].substr(start, pos == std::string::npos? pos: pos - start));
+					if (pos == std::string::npos)
+						break;
+					start = pos + sep.size();
+				}
+			}
+		}
+		else if (fn == "replace" && args.size() == 3)
+		{
+			std::shared_ptr<regex_subst const> re = regex_subst::compile_cached(args[1], args[2]);
+			res = this->get_many(args[0]);
+			for (size_t i = 0; i < res.size(); ++i)
+				re->apply(res[i]);
+		}
+		else if (fn == "unique" && args.size() == 1)
+		{
+			value_list const & values = this->get_many(args[0]);
+			std::set<std::string> seen;
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				if (seen.insert(values[i]).second)
+					res.push_back(values[i]);
+			}
+		}
+		else if ((fn == "basename" || fn == "dirname") && args.size() == 1)
+		{
+			value_list const & values = this->get_many(args[0]);
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				size_t pos = values[i].find_last_of("/\\");
+				if (fn == "basename")
+					res.push_back(pos == std::string::npos? values[i]: values[i].substr(pos + 1));
+				else
+					res.push_back(pos == std::string::npos? std::string(): values[i].substr(0, pos));
+			}
+		}
+		else if (fn == "quote" && args.size() == 1)
+		{
+			res.push_back(args[0]);
+		}
+		else if (fn == "escape_expand" && args.size() >= 1)
+		{
+			for (size_t i = 0; i < args.size(); ++i)
+				res.push_back(escape_expand(args[i]));
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+	}
+
 private:
-	static std::set<std::string> split_options(std::string const & u)
+	// Evaluates a feature file, at most once per environment. Features are
+	// looked up in the mkspec's own features directory, then in the win32
+	// and generic directories next to the mkspecs.
+	void load_feature(std::string const & name, bool ignore_missing)
 	{
-		std::set<std::string> res;
-		size_t start = 0;
-		size_t pos = u.find('|');
-		while (pos != std::string::npos)
+		static char const loaded_var[] = "QMAKE_INTERNAL_INCLUDED_FEATURES";
+
+		std::string fname = name;
+		if (fs::path(fname).extension() != ".prf")
+			fname += ".prf";
+
+		std::vector<fs::path> dirs;
+		std::string spec = this->get_var("QMAKESPEC");
+		if (!spec.empty())
 		{
-			res.insert(u.substr(start, pos - start));
+			fs::path features = fs::path(spec).parent_path() / "features";
+			dirs.push_back(fs::path(spec) / "features");
+			dirs.push_back(features / "win32");
+			dirs.push_back(features);
+		}
 
-			start = pos + 1;
-			pos = u.find('|', start);
+		for (size_t i = 0; i < dirs.size(); ++i)
+		{
+			fs::path p = dirs[i] / fname;
+			if (!this->fs().exists(p))
+				continue;
+
+			std::string path = p.string();
+			value_list const * loaded = this->get(loaded_var);
+			if (loaded && std::find(loaded->begin(), loaded->end(), path) != loaded->end())
+				return;
+
+			this->add_var(loaded_var, path);
+			process_qmake_file(path, *this);
+			return;
+		}
+
+		if (!ignore_missing)
+			throw std::runtime_error("Cannot find feature: " + name);
+	}
+
+	// The slice's relevant set, taken again only when the slice has grown.
+	slice_t::snapshot_t relevant() const
+	{
+		if (!m_relevant || m_relevant_version != m_slice->version())
+			m_relevant = m_slice->snapshot(m_relevant_version);
+		return m_relevant;
+	}
+
+	static std::string escape_expand(std::string const & s)
+	{
+		std::string res;
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			if (s[i] != '\\' || i + 1 == s.size())
+			{
+				res.push_back(s[i]);
+				continue;
+			}
+
+			switch (s[++i])
+			{
+			case 'n': res.push_back('\n'); break;
+			case 't': res.push_back('\t'); break;
+			case 'r': res.push_back('\r'); break;
+			case '\\': res.push_back('\\'); break;
+			default: res.push_back('\\'); res.push_back(s[i]); break;
+			}
+		}
+		return res;
+	}
+
+	// Expands a $$files() pattern. Results keep the directory part of the
+	// pattern as written; relative patterns are resolved against PWD.
+	void glob_files(std::string const & pattern, bool recursive, value_list & res) const
+	{
+		size_t sep = pattern.find_last_of("/\\");
+		std::string prefix = sep == std::string::npos? std::string(): pattern.substr(0, sep + 1);
+		std::string name_pattern = pattern.substr(prefix.size());
+		fs::path dir = fs::absolute(prefix.empty()? fs::path("."): fs::path(prefix), this->get_var("PWD"));
+
+		fs_cache & cache = this->fs();
+		std::vector<std::string> rel_dirs;
+		std::vector<std::shared_ptr<dir_listing const> > listings;
+		if (recursive)
+		{
+			cache.list_recursive(dir, rel_dirs, listings);
+		}
+		else
+		{
+			rel_dirs.push_back(std::string());
+			listings.push_back(cache.list(dir));
+		}
+
+		for (size_t i = 0; i < listings.size(); ++i)
+		{
+			std::string const dir_prefix = rel_dirs[i].empty()? prefix: prefix + rel_dirs[i] + "/";
+			std::vector<std::string> const & files = listings[i]->files;
+			for (size_t j = 0; j < files.size(); ++j)
+			{
+				if (fs_cache::wildcard_match(name_pattern.c_str(), files[j].c_str()))
+					res.push_back(dir_prefix + files[j]);
+			}
+		}
+	}
+
+	// Returns the position of the parenthesis closing the one at `open`,
+	// or nullptr if it isn't closed.
+	static char const * find_call_end(char const * open, char const * last)
+	{
+		int depth = 0;
+		bool quoted = false;
+		for (char const * cur = open; cur != last; ++cur)
+		{
+			if (*cur == '"')
+				quoted = !quoted;
+			else if (quoted)
+				continue;
+			else if (*cur == '(')
+				++depth;
+			else if (*cur == ')' && --depth == 0)
+				return cur;
+		}
+		return nullptr;
+	}
+
+	// Splits function arguments at top-level commas, trimming whitespace
+	// and surrounding quotes, and expands each of them.
+	std::vector<std::string> split_args(char const * first, char const * last) const
+	{
+		std::vector<std::string> res;
+		if (first == last)
+			return res;
+
+		int depth = 0;
+		bool quoted = false;
+		char const * start = first;
+		for (char const * cur = first; ; ++cur)
+		{
+			if (cur == last || (*cur == ',' && depth == 0 && !quoted))
+			{
+				char const * a = start;
+				char const * b = cur;
+				while (a != b && isspace((unsigned char)*a))
+					++a;
+				while (a != b && isspace((unsigned char)b[-1]))
+					--b;
+				if (b - a >= 2 && *a == '"' && b[-1] == '"')
+					++a, --b;
+				res.push_back(this->translate_value(std::string(a, b)));
+
+				if (cur == last)
+					break;
+				start = cur + 1;
+			}
+			else if (*cur == '"')
+				quoted = !quoted;
+			else if (!quoted && *cur == '(')
+				++depth;
+			else if (!quoted && *cur == ')')
+				--depth;
 		}
-		res.insert(u.substr(start));
 		return res;
 	}
 
@@ -323,73 +857,146 @@ private:
 			for (size_t j = 0; !enabled && j < dc.size(); ++j)
 			{
 				cond const & c = dc[j];
-
-				if (c.call.fn == "else" && c.call.args.size() == 0)
+				switch (c.op)
 				{
+				case cond::op_else:
+					count_stat(stat_cond_else);
 					enabled = !last_enabled;
-				}
-				else if (c.call.args.empty())
-				{
-					auto cfg = vars.find("CONFIG");
-					enabled = cfg != vars.end()
-						&& std::find(cfg->second.begin(), cfg->second.end(), c.call.fn) != cfg->second.end();
-				}
-				else if (c.call.fn == "CONFIG" && c.call.args.size() == 1)
-				{
-					auto cfg = vars.find("CONFIG");
-					enabled = cfg != vars.end()
-						&& std::find(cfg->second.begin(), cfg->second.end(), c.call.args[0]) != cfg->second.end();
-				}
-				else if (c.call.fn == "CONFIG" && c.call.args.size() == 2)
-				{
-					std::string const & option = c.call.args[0];
+					break;
+				case cond::op_config:
+					{
+						count_stat(stat_cond_config);
+						std::string const & option = c.call.args.empty()? c.call.fn: c.call.args[0];
+						auto const * cfg = this->get("CONFIG");
+						enabled = cfg && std::find(cfg->begin(), cfg->end(), option) != cfg->end();
+					}
+					break;
+				case cond::op_config_choice:
+					count_stat(stat_cond_config);
 					enabled = false;
-					auto cond_var_it = vars.find("CONFIG");
-					if (cond_var_it != vars.end())
+					if (auto const * cfg = this->get("CONFIG"))
 					{
-						std::vector<std::string> const & opts = cond_var_it->second;
-						std::set<std::string> const & option_universe = split_options(c.call.args[1]);
-						for (size_t i = 0; i < opts.size(); ++i)
+						// The last of the mutually exclusive options wins.
+						std::string const & option = c.call.args[0];
+						for (size_t i = 0; i < cfg->size(); ++i)
 						{
-							if (!option_universe.empty() && option_universe.find(opts[i]) == option_universe.end())
-								continue;
-
-							enabled = (opts[i] == option);
+							if (std::binary_search(c.options.begin(), c.options.end(), (*cfg)[i]))
+								enabled = ((*cfg)[i] == option);
 						}
 					}
-				}
-				else if (c.call.fn == "isEmpty" && c.call.args.size() == 1)
-				{
-					auto var = vars.find(c.call.args[0]);
-					enabled = var == vars.end() || var->second.empty();
-				}
-				else if (c.call.fn == "contains" && c.call.args.size() == 2)
-				{
-					auto const * v = this->get(c.call.args[0]);
-					enabled = v && std::find(v->begin(), v->end(), c.call.args[1]) != v->end();
-				}
-				else if (c.call.fn == "infile" && c.call.args.size() == 3)
-				{
-					env_t nested_env = process_root_qmake_file(fs::absolute(c.call.args[0], this->get_var("PWD")).string());
-					enabled = nested_env.get_var(c.call.args[1]) == c.call.args[2];
-				}
-				else if (c.call.fn == "exists" && c.call.args.size() == 1)
-				{
-					enabled = fs::exists(fs::absolute(c.call.args[0], this->get_var("PWD")));
-				}
-				else
-				{
+					break;
+				case cond::op_isempty:
+					{
+						count_stat(stat_cond_isempty);
+						auto const * var = this->get(c.call.args[0]);
+						enabled = !var || var->empty();
+					}
+					break;
+				case cond::op_contains:
+					{
+						count_stat(stat_cond_contains);
+						auto const * v = this->get(c.call.args[0]);
+						enabled = v && std::find(v->begin(), v->end(), c.call.args[1]) != v->end();
+					}
+					break;
+				case cond::op_infile:
+					{
+						count_stat(stat_cond_infile);
+						std::shared_ptr<env_t const> nested_env = process_infile_root(fs::absolute(c.call.args[0], this->get_var("PWD")).string(), m_opts);
+						enabled = nested_env->get_var(c.call.args[1]) == c.call.args[2];
+					}
+					break;
+				case cond::op_exists:
+					count_stat(stat_cond_exists);
+					enabled = this->fs().exists(fs::absolute(c.call.args[0], this->get_var("PWD")));
+					break;
+				case cond::op_count:
+					{
+						count_stat(stat_cond_count);
+						size_t n = this->get_many(c.call.args[0]).size();
+						enabled = c.compare == '>'? n > c.number: c.compare == '<'? n < c.number: n == c.number;
+					}
+					break;
+				case cond::op_equals:
+					count_stat(stat_cond_equals);
+					enabled = this->get_var(c.call.args[0]) == this->translate_value(c.call.args[1]);
+					break;
+				case cond::op_unresolved:
+					// Every file is resolved by resolve_conditions when loaded.
+					throw std::logic_error("Unresolved condition: " + c.call.fn);
+				default:
 					throw std::runtime_error("Unknown function call: " + c.call.fn);
 				}
+
+				if (c.invert)
+					enabled = !enabled;
 			}
 		}
 
 		return enabled;
 	}
 
-	std::map<std::string, std::vector<std::string> > vars;
+	// Returns a list that is safe to modify, copying it first if it is
+	// shared with another environment or interned.
+	value_list & modify_var(std::string const & name)
+	{
+		count_stat(stat_var_writes);
+		value_ref & v = vars[name];
+		if (!v)
+			v = std::make_shared<value_list>();
+		else if (v.use_count() != 1 || value_pool::is_interned(v))
+			v = std::make_shared<value_list>(*v);
+		return *v;
+	}
+
+	std::map<std::string, value_ref> vars;
+	eval_options m_opts;
+	slice_t * m_slice;
+	mutable slice_t::snapshot_t m_relevant;
+	mutable uint64_t m_relevant_version;
+	std::set<std::string> m_skipped;
 };
 
-void create_msvc_project(env_t const & env, std::string const & proj_file);
+// What every root starts from: the default CONFIG, the injected inputs,
+// and whatever the mkspec's qmake.conf and the default_pre feature set
+// up. It is evaluated once per run and never modified afterwards; roots
+// fork from it.
+struct baseline_env
+{
+	struct source
+	{
+		std::string path;
+		std::time_t mtime;
+		uintmax_t size;
+	};
+
+	env_t env;
+
+	// Evaluated after each root, like qmake's default_post feature.
+	std::vector<std::string> post_files;
+
+	// What the environment was built from, to validate a cached copy.
+	// Sources include files that were looked for but are missing.
+	std::string spec;
+	std::string inputs;
+	std::vector<source> sources;
+	std::map<std::string, std::string> env_vars;
+};
+
+// Evaluates the baseline for the mkspec directory `spec` (none if empty).
+// If `cache_file` is given, a copy saved there by an earlier run is used
+// as long as none of its sources and none of the environment variables it
+// read changed; otherwise the file is rewritten.
+std::shared_ptr<baseline_env const> make_baseline(std::string const & spec, eval_options const & opts, std::string const & cache_file = std::string());
+
+class file_writer_pool;
+
+extern char const * const msvc_project_vars[];
+
+// Derive the GUIDs of projects without a GUID variable from their path
+// instead of picking random ones.
+extern bool g_stable_guids;
+
+void create_msvc_project(env_t const & env, std::string const & proj_file, file_writer_pool & writer);
 
 #endif // ENV_HPP
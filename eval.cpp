@@ -0,0 +1,277 @@
+#include "qmake.hpp"
+#include <fstream>
+#include <stdexcept>
+#include "env.hpp"
+
+static void warn_unknown(eval_options const & opts, std::string const & fname, std::set<std::string> const & unknown)
+{
+	if (!opts.warn)
+		return;
+	for (auto it = unknown.begin(); it != unknown.end(); ++it)
+		opts.warn(fname + ": warning: unknown " + *it);
+}
+
+static std::shared_ptr<block_stmt> parse_qmake_text(char const * first, char const * last, std::set<std::string> & unknown)
+{
+	stat_timer timer(stat_parse_us);
+	parser p;
+	p.push_data(first, last);
+
+	std::shared_ptr<block_stmt> stmts = p.finish();
+	resolve_conditions(*stmts, unknown);
+	return stmts;
+}
+
+// Cuts a file at newlines outside of braces, quotes, comments and line
+// continuations and passes each piece to `f`; every piece holds complete
+// top-level statements.
+template <typename F>
+static void for_each_part(std::filebuf & fin, F f)
+{
+	std::string text;
+	size_t scanned = 0;
+	int depth = 0;
+	bool quoted = false;
+	bool comment = false;
+
+	for (;;)
+	{
+		char buf[1024];
+		std::streamsize read = fin.sgetn(buf, 1024);
+		if (read == 0)
+			break;
+		text.append(buf, buf + read);
+
+		size_t stmt_end = 0;
+		for (; scanned < text.size(); ++scanned)
+		{
+			char ch = text[scanned];
+			if (comment)
+			{
+				comment = ch != '\n';
+				if (!comment && depth == 0)
+					stmt_end = scanned + 1;
+			}
+			else if (ch == '\\' && scanned + 1 < text.size())
+				++scanned;
+			else if (ch == '\\')
+				break;
+			else if (ch == '"')
+				quoted = !quoted;
+			else if (quoted)
+				continue;
+			else if (ch == '#')
+				comment = true;
+			else if (ch == '{')
+				++depth;
+			else if (ch == '}')
+				--depth;
+			else if (ch == '\n' && depth <= 0)
+				stmt_end = scanned + 1;
+		}
+
+		if (stmt_end != 0)
+		{
+			f(text.data(), text.data() + stmt_end);
+			text.erase(0, stmt_end);
+			scanned -= stmt_end;
+		}
+	}
+
+	f(text.data(), text.data() + text.size());
+}
+
+// Evaluates a file one top-level statement at a time, as it is read.
+//
+// Each piece from for_each_part is parsed on its own. A parsed statement
+// is only evaluated once the next statement not starting with `else` has
+// been seen, so that an else-chain and the slice's lookahead always see
+// the whole chain. Nothing is kept once evaluated, so memory is bounded by
+// the largest top-level statement.
+//
+// An assignment is relevant if any later statement reads it, so the slice
+// has to know the whole file before any of it is sliced. A file the slice
+// hasn't seen is therefore read twice, the first time only to add its
+// statements to the slice.
+static void stream_qmake_file(std::filebuf & fin, std::string const & fname, env_t & env, process_context & ctx)
+{
+	eval_options const & opts = env.options();
+	if (opts.slice && !opts.slice->knows_file(fname))
+	{
+		for_each_part(fin, [&](char const * first, char const * last) {
+			std::set<std::string> unknown;
+			opts.slice->add_file_part(*parse_qmake_text(first, last, unknown));
+		});
+		opts.slice->add_file(fname, block_stmt());
+
+		if (fin.pubseekpos(0, std::ios::in) != std::streampos(0))
+			throw std::runtime_error("Cannot rewind file: " + fname);
+	}
+
+	// Unknown functions are reported by the first root that reads the file.
+	bool const report = !opts.cache || opts.cache->claim_warnings(fname);
+	std::set<std::string> unknown;
+
+	block_stmt pending;
+	bool last_enabled = false;
+	for_each_part(fin, [&](char const * first, char const * last) {
+		std::set<std::string> part_unknown;
+		std::shared_ptr<block_stmt> part = parse_qmake_text(first, last, part_unknown);
+		if (report)
+		{
+			for (auto it = unknown.begin(); it != unknown.end(); ++it)
+				part_unknown.erase(*it);
+			warn_unknown(opts, fname, part_unknown);
+			unknown.insert(part_unknown.begin(), part_unknown.end());
+		}
+		pending.stmts.insert(pending.stmts.end(), part->stmts.begin(), part->stmts.end());
+
+		size_t ready = pending.stmts.size();
+		while (ready != 0 && slice_t::uses_else(pending.stmts[ready - 1]))
+			--ready;
+		if (ready != 0)
+			--ready;
+
+		last_enabled = env.process_block_stmt(ctx, &pending, ready, last_enabled);
+		pending.stmts.erase(pending.stmts.begin(), pending.stmts.begin() + ready);
+	});
+
+	env.process_block_stmt(ctx, &pending, pending.stmts.size(), last_enabled);
+}
+
+// Parses a file, or returns the AST another root has already parsed.
+static std::shared_ptr<block_stmt> load_qmake_file(std::string const & fname, eval_options const & opts)
+{
+	eval_cache * cache = opts.cache;
+	if (cache)
+	{
+		if (std::shared_ptr<block_stmt> stmts = cache->find_file(fname))
+			return stmts;
+	}
+
+	std::filebuf fin;
+	if (!fin.open(fname, std::ios::in))
+		return nullptr;
+
+	stat_timer timer(stat_parse_us);
+	parser p;
+	for (;;)
+	{
+		char buf[1024];
+		std::streamsize read = fin.sgetn(buf, 1024);
+		if (read == 0)
+			break;
+		p.push_data(buf, buf + read);
+	}
+
+	std::shared_ptr<block_stmt> stmts = p.finish();
+	std::set<std::string> unknown;
+	resolve_conditions(*stmts, unknown);
+
+	// If another root parsed the file concurrently, it reports.
+	std::shared_ptr<block_stmt> res = cache? cache->add_file(fname, stmts): stmts;
+	if (res == stmts)
+		warn_unknown(opts, fname, unknown);
+	return res;
+}
+
+bool process_qmake_file(std::string const & fname, env_t & env)
+{
+	std::string old_pwd = env.get_var("PWD");
+
+	size_t pos = fname.find_last_of("/\\");
+	std::string dir = pos == std::string::npos? "": fname.substr(0, pos);
+	env.set_var("PWD", dir);
+
+	process_context ctx(fname);
+	eval_cache * cache = env.options().cache;
+	if (env.options().stream && !(cache && cache->find_file(fname)))
+	{
+		std::filebuf fin;
+		if (!fin.open(fname, std::ios::in))
+			return false;
+
+		stream_qmake_file(fin, fname, env, ctx);
+	}
+	else
+	{
+		std::shared_ptr<block_stmt> stmts = load_qmake_file(fname, env.options());
+		if (!stmts)
+			return false;
+
+		if (slice_t * slice = env.options().slice)
+			slice->add_file(fname, *stmts);
+
+		env.process_block_stmt(ctx, stmts.get());
+	}
+
+	env.set_var("PWD", old_pwd);
+	return true;
+}
+
+void init_root_env(env_t & env, eval_options const & opts)
+{
+	env.add_var("CONFIG", "debug");
+	env.add_var("CONFIG", "win32");
+	env.add_var("CONFIG", "win32-msvc*");
+	if (opts.inputs)
+	{
+		for (size_t i = 0; i < opts.inputs->config.size(); ++i)
+			env.add_var("CONFIG", opts.inputs->config[i]);
+	}
+}
+
+env_t process_root_qmake_file(std::string const & fname, eval_options const & opts)
+{
+	slice_t * slice = opts.slice;
+	stats_scope scope(fname);
+	stat_timer timer(stat_eval_us);
+	for (;;)
+	{
+		env_t env = opts.baseline? env_t(opts.baseline->env, opts): env_t(opts);
+		if (!opts.baseline)
+			init_root_env(env, opts);
+
+		env.set_var("ROOT_FILE", fname);
+		env.add_var("ROOT_DIR", fs::path(fname).remove_filename().string());
+
+		process_qmake_file(fname, env);
+		if (opts.baseline)
+		{
+			for (size_t i = 0; i < opts.baseline->post_files.size(); ++i)
+				process_qmake_file(opts.baseline->post_files[i], env);
+		}
+
+		// Files included late may have made a skipped variable relevant;
+		// the slice only grows, so this converges.
+		if (!slice || !slice->any_relevant(env.skipped_vars()))
+		{
+			env.intern_values();
+			return env;
+		}
+	}
+}
+
+std::shared_ptr<env_t const> process_infile_root(std::string const & fname, eval_options const & opts)
+{
+	std::string key = fname;
+	if (opts.inputs)
+		key.append("\n").append(opts.inputs->fingerprint());
+	if (opts.qt)
+		key.append("\nq").append(opts.qt->fingerprint());
+
+	if (opts.cache)
+	{
+		// A cached environment is stale if it skipped a variable that has
+		// become relevant since.
+		std::shared_ptr<env_t const> env = opts.cache->find_root(key);
+		if (env && (!opts.slice || !opts.slice->any_relevant(env->skipped_vars())))
+			return env;
+	}
+
+	std::shared_ptr<env_t> env = std::make_shared<env_t>(process_root_qmake_file(fname, opts));
+	env->detach();
+	if (opts.cache)
+		opts.cache->set_root(key, env);
+	return env;
+}
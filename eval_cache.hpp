@@ -0,0 +1,100 @@
+#ifndef EVAL_CACHE_HPP
+#define EVAL_CACHE_HPP
+
+#include "ast.hpp"
+#include "fs_cache.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class env_t;
+
+// State shared by all roots evaluated with the same options: parsed files,
+// the environments of projects evaluated for infile() and the directory
+// listings. Entries are immutable once published, so roots may be evaluated
+// concurrently.
+class eval_cache
+{
+public:
+	std::shared_ptr<block_stmt> find_file(std::string const & fname) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_files.find(fname);
+		return it == m_files.end()? nullptr: it->second;
+	}
+
+	// Publishes a parsed file; if another thread got there first, its
+	// AST is returned instead.
+	std::shared_ptr<block_stmt> add_file(std::string const & fname, std::shared_ptr<block_stmt> const & stmts)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_files.insert(std::make_pair(fname, stmts)).first->second;
+	}
+
+	std::vector<std::string> file_names() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::string> res;
+		for (auto it = m_files.begin(); it != m_files.end(); ++it)
+			res.push_back(it->first);
+		return res;
+	}
+
+	// Roots are keyed by file name and the fingerprints of the injected
+	// inputs and Qt properties they were evaluated with.
+	std::shared_ptr<env_t const> find_root(std::string const & key) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_roots.find(key);
+		return it == m_roots.end()? nullptr: it->second;
+	}
+
+	void set_root(std::string const & key, std::shared_ptr<env_t const> const & env)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_roots[key] = env;
+	}
+
+	// Returns true the first time it is called for a project, so that
+	// roots sharing a subproject generate it only once.
+	bool claim_project(std::string const & fname)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_generated.insert(fname).second;
+	}
+
+	// Returns true the first time it is called for a streamed file, which
+	// is not kept in the cache, so that its warnings are reported once.
+	bool claim_warnings(std::string const & fname)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_streamed.insert(fname).second;
+	}
+
+	fs_cache & fs() { return m_fs; }
+
+	void clear()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_files.clear();
+			m_roots.clear();
+			m_generated.clear();
+			m_streamed.clear();
+		}
+		m_fs.clear();
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::map<std::string, std::shared_ptr<block_stmt> > m_files;
+	std::map<std::string, std::shared_ptr<env_t const> > m_roots;
+	std::set<std::string> m_generated;
+	std::set<std::string> m_streamed;
+	fs_cache m_fs;
+};
+
+#endif // EVAL_CACHE_HPP
@@ -0,0 +1,220 @@
+#ifndef FS_CACHE_HPP
+#define FS_CACHE_HPP
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct dir_listing
+{
+	std::vector<std::string> files;
+	std::vector<std::string> dirs;
+};
+
+// A cache of directory contents used by $$files() and of the results of
+// exists(). Each eval_cache has its own; instance() serves evaluations
+// without one.
+//
+// Source trees don't change while we run, so every directory is enumerated
+// at most once, no matter how many projects glob it; files we generate
+// ourselves are reported through forget(). Recursive globs list each level
+// of the tree concurrently and don't follow symbolic links.
+class fs_cache
+{
+public:
+	static fs_cache & instance()
+	{
+		static fs_cache cache;
+		return cache;
+	}
+
+	std::shared_ptr<dir_listing const> list(boost::filesystem::path const & dir)
+	{
+		std::string key = make_key(dir);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_dirs.find(key);
+			if (it != m_dirs.end())
+				return it->second;
+		}
+
+		std::shared_ptr<dir_listing> res = std::make_shared<dir_listing>();
+		boost::system::error_code ec;
+		for (boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+		{
+			// A link to a directory is listed as a file, so that a link
+			// cycle can't make a recursive glob loop forever.
+			boost::system::error_code status_ec;
+			if (boost::filesystem::is_directory(it->symlink_status(status_ec)))
+				res->dirs.push_back(it->path().filename().string());
+			else
+				res->files.push_back(it->path().filename().string());
+		}
+		std::sort(res->files.begin(), res->files.end());
+		std::sort(res->dirs.begin(), res->dirs.end());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_dirs.insert(std::make_pair(key, res)).first->second;
+	}
+
+	bool exists(boost::filesystem::path const & p)
+	{
+		std::string key = make_key(p);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_exists.find(key);
+			if (it != m_exists.end())
+				return it->second;
+		}
+
+		boost::system::error_code ec;
+		bool res = boost::filesystem::exists(p, ec);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exists[key] = res;
+		return res;
+	}
+
+	// Drops what is known about `p` and the listing of its directory,
+	// e.g. after the file has been created.
+	void forget(boost::filesystem::path const & p)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exists.erase(make_key(p));
+		m_dirs.erase(make_key(p.parent_path()));
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_dirs.clear();
+		m_exists.clear();
+	}
+
+	// The paths exists() was asked about, whether they were found or not,
+	// and the directories listed so far.
+	std::vector<std::string> probed() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::string> res;
+		for (auto it = m_exists.begin(); it != m_exists.end(); ++it)
+			res.push_back(it->first);
+		for (auto it = m_dirs.begin(); it != m_dirs.end(); ++it)
+			res.push_back(it->first);
+		return res;
+	}
+
+	// Lists `dir` and all directories below it. Appends the paths of the
+	// directories relative to `dir` (with "" for `dir` itself) to `rel_dirs`
+	// and their listings to `listings`.
+	void list_recursive(boost::filesystem::path const & dir, std::vector<std::string> & rel_dirs,
+		std::vector<std::shared_ptr<dir_listing const> > & listings)
+	{
+		size_t const batch = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<std::string> level(1, std::string());
+		while (!level.empty())
+		{
+			std::vector<std::string> next;
+			for (size_t first = 0; first < level.size(); first += batch)
+			{
+				size_t last = std::min(level.size(), first + batch);
+
+				std::vector<std::future<std::shared_ptr<dir_listing const> > > pending;
+				for (size_t i = first + 1; i < last; ++i)
+					pending.push_back(std::async(std::launch::async, &fs_cache::list, this, dir / level[i]));
+
+				for (size_t i = first; i < last; ++i)
+				{
+					std::shared_ptr<dir_listing const> l = i == first? this->list(dir / level[i]): pending[i - first - 1].get();
+					rel_dirs.push_back(level[i]);
+					listings.push_back(l);
+
+					for (size_t j = 0; j < l->dirs.size(); ++j)
+						next.push_back(level[i].empty()? l->dirs[j]: level[i] + "/" + l->dirs[j]);
+				}
+			}
+			level.swap(next);
+		}
+	}
+
+	// Matches `*`, `?` and `[...]` wildcards against the whole of `name`.
+	static bool wildcard_match(char const * pat, char const * name)
+	{
+		for (; *pat; ++pat, ++name)
+		{
+			if (*pat == '*')
+			{
+				while (pat[1] == '*')
+					++pat;
+				for (char const * rest = name; ; ++rest)
+				{
+					if (wildcard_match(pat + 1, rest))
+						return true;
+					if (!*rest)
+						return false;
+				}
+			}
+
+			if (!*name)
+				return false;
+
+			if (*pat == '[')
+			{
+				char const * close = strchr(pat + 1, ']');
+				if (close)
+				{
+					bool negate = pat[1] == '!' || pat[1] == '^';
+					bool found = false;
+					for (char const * p = pat + 1 + negate; p < close; ++p)
+					{
+						if (p + 2 < close && p[1] == '-')
+						{
+							found = found || (*name >= p[0] && *name <= p[2]);
+							p += 2;
+						}
+						else
+						{
+							found = found || *name == *p;
+						}
+					}
+					if (found == negate)
+						return false;
+					pat = close;
+					continue;
+				}
+			}
+
+			if (*pat != '?' && *pat != *name)
+				return false;
+		}
+		return !*name;
+	}
+
+private:
+	// Spellings of a path that differ only in "." components or separators
+	// share an entry.
+	static std::string make_key(boost::filesystem::path const & p)
+	{
+		boost::filesystem::path res;
+		for (auto it = p.begin(); it != p.end(); ++it)
+		{
+			if (*it != ".")
+				res /= *it;
+		}
+		return res.generic_string();
+	}
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, std::shared_ptr<dir_listing const> > m_dirs;
+	std::map<std::string, bool> m_exists;
+};
+
+#endif // FS_CACHE_HPP
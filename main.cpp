@@ -1,68 +1,44 @@
-#include "qmake.hpp"
 #include <fstream>
 #include <stdexcept>
 #include <map>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include "env.hpp"
+#include "writer.hpp"
+#include "stats.hpp"
 
 void print_vars(env_t const & env)
 {
 	for (auto it = env.begin(); it != env.end(); ++it)
 	{
 		std::cout << it->first << ":" << std::endl;
-		for (size_t i = 0; i < it->second.size(); ++i)
+		value_list const & values = *it->second;
+		for (size_t i = 0; i < values.size(); ++i)
 		{
-			std::cout << "    " << it->second[i] << std::endl;
+			std::cout << "    " << values[i] << std::endl;
 		}
 	}
 }
 
-bool process_qmake_file(std::string const & fname, env_t & env)
+// Whether this run still has to generate the project; the first root to
+// get to a shared subproject does it.
+static bool claim_project(eval_options const & opts, fs::path const & fname)
 {
-	std::string old_pwd = env.get_var("PWD");
+	if (!opts.cache)
+		return true;
 
-	size_t pos = fname.find_last_of("/\\");
-	std::string dir = pos == std::string::npos? "": fname.substr(0, pos);
-	env.set_var("PWD", dir);
-
-	std::filebuf fin;
-	if (!fin.open(fname, std::ios::in))
-		return false;
-
-	parser p;
-	for (;;)
-	{
-		char buf[1024];
-		std::streamsize read = fin.sgetn(buf, 1024);
-		if (read == 0)
-			break;
-		p.push_data(buf, buf + read);
-	}
-
-	std::shared_ptr<block_stmt> stmts = p.finish();
-
-	process_context ctx(fname);
-	env.process_block_stmt(ctx, stmts.get());
-
-	env.set_var("PWD", old_pwd);
-	return true;
+	boost::system::error_code ec;
+	fs::path p = fs::canonical(fname, ec);
+	return opts.cache->claim_project(ec? fs::absolute(fname).string(): p.string());
 }
 
-env_t process_root_qmake_file(std::string const & fname)
-{
-	env_t env;
-	env.add_var("CONFIG", "debug");
-	env.add_var("CONFIG", "win32");
-	env.add_var("CONFIG", "win32-msvc*");
-
-	env.set_var("ROOT_FILE", fname);
-	env.add_var("ROOT_DIR", fs::path(fname).remove_filename().string());
-
-	process_qmake_file(fname, env);
-	return env;
-}
-
-void make_project(env_t const & env)
+void make_project(env_t const & env, file_writer_pool & writer)
 {
 	std::string const & templ = env.get_one("TEMPLATE");
 	if (templ == "subdirs")
@@ -75,8 +51,12 @@ void make_project(env_t const & env)
 		{
 			std::string const & subdir = subdirs[i];
 
-			env_t nested_env = process_root_qmake_file(fs::absolute(fs::path(subdir) / (subdir + ".pro"), env.get_one("ROOT_DIR")).string());
-			make_project(nested_env);
+			fs::path nested = fs::absolute(fs::path(subdir) / (subdir + ".pro"), env.get_one("ROOT_DIR"));
+			if (!claim_project(env.options(), nested))
+				continue;
+
+			env_t nested_env = process_root_qmake_file(nested.string(), env.options());
+			make_project(nested_env, writer);
 		}
 	}
 	else if (templ == "lib")
@@ -87,7 +67,9 @@ void make_project(env_t const & env)
 	{
 		//print_vars(env);
 
-		create_msvc_project(env, fs::path(env.get_var("ROOT_FILE")).replace_extension(".vcxproj").string());
+		stats_scope scope(env.get_var("ROOT_FILE"));
+		stat_timer timer(stat_generate_us);
+		create_msvc_project(env, fs::path(env.get_var("ROOT_FILE")).replace_extension(".vcxproj").string(), writer);
 	}
 	else
 	{
@@ -95,24 +77,223 @@ void make_project(env_t const & env)
 	}
 }
 
-void make_solution(env_t const & env)
+void make_solution(env_t const & env, file_writer_pool & writer)
+{
+	make_project(env, writer);
+}
+
+// Appends the root files listed in a response file, one per line.
+static bool read_response_file(char const * fname, std::vector<std::string> & roots)
 {
-	make_project(env);
+	std::ifstream fin(fname);
+	if (!fin)
+		return false;
+
+	std::string line;
+	while (std::getline(fin, line))
+	{
+		size_t first = line.find_first_not_of(" \t\r");
+		size_t last = line.find_last_not_of(" \t\r");
+		if (first != std::string::npos && line[first] != '#')
+			roots.push_back(line.substr(first, last - first + 1));
+	}
+	return true;
 }
 
 int main(int argc, char * argv[])
 {
-	srand(time(0));
+	bool use_slice = true;
+	bool stream = false;
+	bool print_stats = false;
+	char const * stats_file = nullptr;
+	std::string spec;
+	std::shared_ptr<eval_inputs> inputs = std::make_shared<eval_inputs>();
+	std::string baseline_cache;
+	char const * qt_props_file = nullptr;
+	char const * stats_baseline = nullptr;
+	double max_regression = 0;
+	size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::string> roots;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--no-slice") == 0)
+			use_slice = false;
+		else if (strcmp(argv[i], "--stream") == 0)
+			stream = true;
+		else if (strcmp(argv[i], "--stats") == 0)
+			g_stats_enabled = print_stats = true;
+		else if (strncmp(argv[i], "--stats=", 8) == 0)
+			g_stats_enabled = print_stats = true, stats_file = argv[i] + 8;
+		else if (strncmp(argv[i], "--stats-baseline=", 17) == 0)
+			g_stats_enabled = true, stats_baseline = argv[i] + 17;
+		else if (strncmp(argv[i], "--max-regression=", 17) == 0)
+			max_regression = atof(argv[i] + 17);
+		else if (strcmp(argv[i], "--stable-guids") == 0)
+			g_stable_guids = true;
+		else if (strncmp(argv[i], "--config=", 9) == 0)
+			inputs->config.push_back(argv[i] + 9);
+		else if (strncmp(argv[i], "--spec=", 7) == 0)
+			spec = argv[i] + 7;
+		else if (strncmp(argv[i], "--baseline-cache=", 17) == 0)
+			baseline_cache = argv[i] + 17;
+		else if (strncmp(argv[i], "--qt-props=", 11) == 0)
+			qt_props_file = argv[i] + 11;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			jobs = std::max(1, atoi(argv[++i]));
+		else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2])
+			jobs = std::max(1, atoi(argv[i] + 2));
+		else if (argv[i][0] == '@')
+		{
+			if (!read_response_file(argv[i] + 1, roots))
+			{
+				std::cout << "Cannot read response file: " << argv[i] + 1 << std::endl;
+				return 2;
+			}
+		}
+		else
+			roots.push_back(argv[i]);
+	}
+
+	if (roots.empty())
+	{
+		std::cout << "Usage: " << argv[0] << " [--no-slice] [--stream] [--stats[=<file>]] [--stats-baseline=<file> [--max-regression=<percent>]] [--stable-guids] [--spec=<mkspec dir>] [--config=<value>]... [--baseline-cache=<file>] [--qt-props=<file>] [-j <jobs>] <root.pro>... [@<response file>]" << std::endl;
+		return 2;
+	}
 
+	// Only statements that can affect the variables make_project and
+	// create_msvc_project read are evaluated, unless --no-slice is given.
+	std::vector<std::string> outputs;
+	outputs.push_back("TEMPLATE");
+	outputs.push_back("SUBDIRS");
+	outputs.push_back("ROOT_DIR");
+	for (char const * const * v = msvc_project_vars; *v; ++v)
+		outputs.push_back(*v);
+	slice_t slice(outputs);
+
+	// All roots share the parsed files, the filesystem cache, the slice
+	// and the output writer.
+	eval_cache cache;
+	eval_options opts;
+	opts.slice = use_slice? &slice: nullptr;
+	opts.cache = &cache;
+	opts.stream = stream;
+	opts.inputs = inputs;
+
+	std::mutex warn_mutex;
+	opts.warn = [&](std::string const & msg) {
+		std::lock_guard<std::mutex> lock(warn_mutex);
+		std::cerr << msg << std::endl;
+	};
+
+	// Every root, subproject and infile() project starts from a copy of
+	// the baseline. Qt properties are given either as NAME=value lines or
+	// as the output of `qmake -query`.
 	try
 	{
-		env_t env = process_root_qmake_file(argv[1]);
-		make_solution(env);
-		//print_vars(env);
+		if (qt_props_file)
+			opts.qt = qt_props::load(qt_props_file);
+		opts.baseline = make_baseline(spec, opts, baseline_cache);
 	}
 	catch (std::exception const & e)
 	{
 		std::cout << e.what() << std::endl;
 		return 1;
 	}
+
+	// Generated files, e.g. the precompiled header stubs, may be tested
+	// for with exists() by later projects.
+	file_writer_pool writer;
+	writer.on_written([&cache](std::string const & path) {
+		cache.fs().forget(path);
+	});
+
+	std::mutex report_mutex;
+	std::atomic<size_t> next_root(0);
+	int res = 0;
+
+	auto report = [&](std::string const & root, char const * msg) {
+		std::lock_guard<std::mutex> lock(report_mutex);
+		if (roots.size() > 1)
+			std::cout << root << ": ";
+		std::cout << msg << std::endl;
+		res = 1;
+	};
+
+	auto worker = [&]() {
+		for (;;)
+		{
+			size_t i = next_root++;
+			if (i >= roots.size())
+				return;
+
+			try
+			{
+				// Files are listed relative to their project's directory,
+				// which must be absolute, as it is for subprojects.
+				std::string root = fs::absolute(roots[i]).string();
+				if (!claim_project(opts, root))
+					continue;
+
+				env_t env = process_root_qmake_file(root, opts);
+				make_solution(env, writer);
+				//print_vars(env);
+			}
+			catch (std::exception const & e)
+			{
+				report(roots[i], e.what());
+			}
+		}
+	};
+
+	auto const start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < std::min(jobs, roots.size()); ++i)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	try
+	{
+		writer.wait();
+	}
+	catch (std::exception const & e)
+	{
+		std::lock_guard<std::mutex> lock(report_mutex);
+		std::cout << e.what() << std::endl;
+		res = 1;
+	}
+
+	count_stat(stat_wall_us, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+	if (print_stats)
+	{
+		if (stats_file)
+		{
+			std::ofstream fout(stats_file);
+			write_stats_json(fout);
+		}
+		else
+		{
+			write_stats_json(std::cout);
+		}
+	}
+
+	// Fails the run if it did more work than the one that wrote the baseline.
+	if (stats_baseline)
+	{
+		std::ifstream fin(stats_baseline);
+		if (!fin)
+		{
+			std::cout << "Cannot read stats baseline: " << stats_baseline << std::endl;
+			res = 1;
+		}
+		else if (!check_stats_regression(fin, max_regression, std::cout))
+		{
+			res = 1;
+		}
+	}
+
+	return res;
 }
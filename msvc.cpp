@@ -1,6 +1,12 @@
 #include "env.hpp"
+#include "writer.hpp"
+#include <mutex>
+#include <random>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/uuid/name_generator.hpp>
+#include <boost/uuid/string_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
 namespace fs = boost::filesystem;
 
 static char const msvc_filters_template[] =
@@ -117,12 +123,26 @@ static char const msvc_template[] =
 	"  </ImportGroup>\n"
 	"</Project>";
 
+// Variables read by create_msvc_project; everything else may be sliced away.
+char const * const msvc_project_vars[] = {
+	"SOURCES", "HEADERS", "INCLUDEPATH", "RESOURCES", "DEFINES", "QT", "FORMS", "RC_FILE",
+	"OTHER_FILES", "TRANSLATIONS", "MOC_DIR", "RCC_DIR", "UI_DIR", "DESTDIR", "OBJECTS_DIR",
+	"PRECOMPILED_HEADER", "TARGET", "GUID", "ROOT_FILE",
+	0
+};
+
+// Derive project GUIDs from the project path instead of generating random
+// ones, so that repeated runs produce identical files (--stable-guids).
+bool g_stable_guids = false;
+
 fs::path relative(fs::path const & p, fs::path const & base)
 {
 	if (p == base)
 		return ".";
 
-	if (p.root_name() != base.root_name())
+	// A relative path can't be rebased onto an absolute one; as on
+	// different drives, keep it as given.
+	if (p.root_name() != base.root_name() || p.has_root_directory() != base.has_root_directory())
 		return p;
 
 	fs::path from_path, from_base, output;
@@ -188,17 +208,40 @@ fs::path relative(fs::path const & p)
 	return relative(p, fs::current_path());
 }
 
-void add_file_items(std::string const & proj_file_dir, std::vector<std::string> sources, std::string const & tag, std::string & files,
+static bool deref_less(std::string const * lhs, std::string const * rhs)
+{
+	return *lhs < *rhs;
+}
+
+static bool deref_equal(std::string const * lhs, std::string const * rhs)
+{
+	return *lhs == *rhs;
+}
+
+static env_t::vector_iter as_iter(std::vector<std::string> const & v)
+{
+	return env_t::vector_iter(v.data(), v.data() + v.size());
+}
+
+void add_file_items(std::string const & proj_file_dir, env_t::vector_iter sources_range, std::string const & tag, std::string & files,
 	std::string & filter_items, std::set<std::string> & filters, std::string const & props = "")
 {
-	std::sort(sources.begin(), sources.end());
-	sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+	// Sort pointers into the environment's storage rather than a copy of the strings.
+	std::vector<std::string const *> sources;
+	sources.reserve(sources_range.size());
+	for (auto it = sources_range.begin(); it != sources_range.end(); ++it)
+		sources.push_back(it);
+
+	std::sort(sources.begin(), sources.end(), &deref_less);
+	sources.erase(std::unique(sources.begin(), sources.end(), &deref_equal), sources.end());
 	for (auto it = sources.begin(); it != sources.end(); ++it)
 	{
-		std::string relpath = relative(*it, proj_file_dir).string();
+		// Split off the filter before the separators are converted, as
+		// backslashes are not separators everywhere.
+		fs::path p = relative(**it, proj_file_dir);
+		std::string relpath = p.string();
 		boost::algorithm::replace_all(relpath, "/", "\\");
-
-		fs::path p = fs::path(relpath).remove_filename();
+		p.remove_filename();
 
 		if (props.empty())
 		{
@@ -223,7 +266,7 @@ void add_file_items(std::string const & proj_file_dir, std::vector<std::string>
 	}
 }
 
-void create_msvc_project(env_t const & env, std::string const & proj_file)
+void create_msvc_project(env_t const & env, std::string const & proj_file, file_writer_pool & writer)
 {
 	fs::path proj_file_dir(proj_file);
 	proj_file_dir.remove_filename();
@@ -234,10 +277,10 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 	std::string filter_items;
 	std::set<std::string> filters;
 
-	std::vector<std::string> var_sources = env.get_var_many("SOURCES");
-	std::vector<std::string> var_headers = env.get_var_many("HEADERS");
+	env_t::vector_iter var_sources = env.get_var_many("SOURCES");
+	env_t::vector_iter var_headers = env.get_var_many("HEADERS");
 	std::vector<std::string> includepaths = env.get_var_many("INCLUDEPATH");
-	std::vector<std::string> var_resources = env.get_var_many("RESOURCES");
+	env_t::vector_iter var_resources = env.get_var_many("RESOURCES");
 
 	std::vector<std::string> c_sources, cpp_sources;
 	for (size_t i = 0; i < var_sources.size(); ++i)
@@ -256,7 +299,7 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 
 			std::string defines;
 
-			auto const & defines_var = env.get_var_many("DEFINES");
+			env_t::vector_iter defines_var = env.get_var_many("DEFINES");
 			for (auto it = defines_var.begin(); it != defines_var.end(); ++it)
 			{
 				if (!defines.empty())
@@ -273,7 +316,7 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 			includepaths.push_back(moc_dir);
 
 			for (size_t i = 0; i < var_headers.size(); ++i)
-				cpp_sources.push_back(moc_dir + "\\moc_" + fs::path(var_headers[i]).filename().replace_extension().string() + ".cpp");
+				cpp_sources.push_back(moc_dir + "/moc_" + fs::path(var_headers[i]).filename().replace_extension().string() + ".cpp");
 		}
 	}
 
@@ -289,12 +332,12 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 				"    </QtRcCompile>\n");
 
 			for (size_t i = 0; i < var_resources.size(); ++i)
-				cpp_sources.push_back(rcc_dir + "\\qrc_" + fs::path(var_resources[i]).filename().replace_extension().string() + ".cpp");
+				cpp_sources.push_back(rcc_dir + "/qrc_" + fs::path(var_resources[i]).filename().replace_extension().string() + ".cpp");
 		}
 	}
 
-	add_file_items(proj_file_dir.string(), cpp_sources, "ClCompile", files, filter_items, filters);
-	add_file_items(proj_file_dir.string(), c_sources, "ClCompile", files, filter_items, filters,
+	add_file_items(proj_file_dir.string(), as_iter(cpp_sources), "ClCompile", files, filter_items, filters);
+	add_file_items(proj_file_dir.string(), as_iter(c_sources), "ClCompile", files, filter_items, filters,
 		"      <PrecompiledHeader>NotUsing</PrecompiledHeader>\n"
 		"      <ForcedIncludeFiles></ForcedIncludeFiles>\n");
 	add_file_items(proj_file_dir.string(), var_headers, "QtMoc", files, filter_items, filters);
@@ -308,22 +351,22 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 	std::vector<std::string> debug_libs, release_libs;
 
 	{
-		auto const & qt = env.get_var_many("QT");
+		qt_props const & props = env.qt();
+		env_t::vector_iter qt = env.get_var_many("QT");
 		for (auto it = qt.begin(); it != qt.end(); ++it)
 		{
-			std::string component = *it;
-			if (component.empty())
+			if (it->empty())
 				continue;
 
-			component[0] = ::toupper(component[0]);
-			includepaths.push_back(env.translate_value("$$[QT_INSTALL_HEADER]/Qt" + component));
-			debug_libs.push_back("Qt" + component + "d4.lib");
-			release_libs.push_back("Qt" + component + "4.lib");
+			qt_component const & component = props.component(*it);
+			includepaths.push_back(component.include_dir);
+			debug_libs.push_back(component.debug_lib);
+			release_libs.push_back(component.release_lib);
 		}
-	}
 
-	includepaths.push_back(env.translate_value("$$[QT_INSTALL_HEADER]"));
-	lib_paths.push_back(env.translate_value("$$[QT_INSTALL_LIB]"));
+		includepaths.push_back(props.include_dir());
+		lib_paths.push_back(props.lib_dir());
+	}
 
 
 	{
@@ -343,10 +386,7 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 	std::string pch = env.get_var("PRECOMPILED_HEADER");
 	if (!pch.empty())
 	{
-		{
-			std::ofstream fout(fs::absolute(pch + ".cpp", proj_file_dir).string());
-			fout << "#include \"" + pch + "\"\n";
-		}
+		writer.write(fs::absolute(pch + ".cpp", proj_file_dir).string(), "#include \"" + pch + "\"\n");
 
 		files.append(
 			"    <ClCompile Include=\"" + pch + ".cpp\">\n"
@@ -378,23 +418,40 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 
 	{
 		std::string guid = env.get_var("GUID");
-		if (guid.empty())
+		if (guid.empty() && g_stable_guids)
+		{
+			// A name-based UUID of the project's path relative to the
+			// working directory, so that reruns from the same place agree.
+			static boost::uuids::uuid const ns = boost::uuids::string_generator()("{6d3c0b8e-2f4a-4c61-9b57-0e8f1a2d7c45}");
+			boost::uuids::name_generator gen(ns);
+			guid = "{" + boost::to_upper_copy(boost::uuids::to_string(gen(relative(proj_file, fs::current_path()).generic_string()))) + "}";
+		}
+		else if (guid.empty())
 		{
 			static char const digits[] = "0123456789ABCDEF";
+			static std::mutex rng_mutex;
+			static std::mt19937 rng((std::random_device())());
+
+			std::lock_guard<std::mutex> lock(rng_mutex);
 			guid = "{????????-????-????-????-????????????}";
 			for (size_t i = 0; i < guid.size(); ++i)
 			{
 				if (guid[i] == '?')
-					guid[i] = digits[rand() % 16];
+					guid[i] = digits[rng() % 16];
 			}
 		}
 
 		boost::replace_all(res, "$guid", guid);
 	}
 
-	std::ofstream fout(proj_file);
-	fout << res;
-	fout.close();
+	// Settings of variables the project doesn't set are left out.
+	boost::replace_all(res, "$qtuisettings", "");
+	boost::replace_all(res, "$qtmocsettings", "");
+	boost::replace_all(res, "$qtrccsettings", "");
+	boost::replace_all(res, "$pch", "");
+	boost::replace_all(res, "$targetname", "");
+
+	writer.write(proj_file, res);
 
 	for (auto it = filters.begin(); it != filters.end(); ++it)
 	{
@@ -404,8 +461,5 @@ void create_msvc_project(env_t const & env, std::string const & proj_file)
 
 	res = msvc_filters_template;
 	boost::replace_all(res, "$items", filter_items);
-
-	std::ofstream ffout(proj_file + ".filters");
-	ffout << res;
-	ffout.close();
+	writer.write(proj_file + ".filters", res);
 }
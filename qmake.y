@@ -103,4 +103,4 @@ PARAM_TEXT :: {std::string}
 PARAM_TEXT ~= {([^"\s,\(\)]|"([^"]|\\")*")+}
 
 TEXT :: {std::string}
-TEXT ~= {([^"\s]|"([^"]|\\")*")+}
+TEXT ~= {([^"\s]|"([^"]|\\")*"|[$][$][A-Za-z0-9_]+\(([^"\(\)\n]|"([^"]|\\")*"|\([^"\(\)\n]*\))*\))+}
@@ -0,0 +1,157 @@
+#include "qmake_eval.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include "env.hpp"
+
+struct qmake_session
+{
+	eval_cache cache;
+};
+
+struct qmake_project
+{
+	std::shared_ptr<env_t const> env;
+	std::vector<env_t::const_iterator> vars;
+	std::vector<std::string> warnings;
+	std::string error;
+};
+
+static void split_assignments(char const * const * items, size_t count, std::map<std::string, std::string> & out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		char const * eq = strchr(items[i], '=');
+		if (!eq)
+			throw std::runtime_error(std::string("Expected NAME=value: ") + items[i]);
+		out[std::string(items[i], eq)] = eq + 1;
+	}
+}
+
+static std::shared_ptr<eval_inputs const> make_inputs(qmake_eval_params const * params)
+{
+	std::shared_ptr<eval_inputs> res = std::make_shared<eval_inputs>();
+	if (!params)
+		return res;
+
+	res->config.assign(params->config, params->config + params->config_count);
+	split_assignments(params->environment, params->environment_count, res->environment);
+	res->inherit_environment = params->inherit_environment != 0;
+	return res;
+}
+
+// Injected properties replace the built-in ones for $$[NAME] and for the
+// Qt paths alike.
+static std::shared_ptr<qt_props const> make_qt_props(qmake_eval_params const * params)
+{
+	std::map<std::string, std::string> properties;
+	if (params)
+		split_assignments(params->properties, params->properties_count, properties);
+	return properties.empty()? nullptr: qt_props::with_overrides(*qt_props::builtin(), properties);
+}
+
+static value_list const * find_values(qmake_project const * project, char const * name)
+{
+	return project && project->env? project->env->get(name): nullptr;
+}
+
+qmake_session * qmake_session_create(void)
+{
+	return new (std::nothrow) qmake_session();
+}
+
+void qmake_session_destroy(qmake_session * session)
+{
+	delete session;
+}
+
+void qmake_session_reset(qmake_session * session)
+{
+	session->cache.clear();
+}
+
+qmake_project * qmake_project_load(qmake_session * session, char const * root, qmake_eval_params const * params)
+{
+	qmake_project * project = new (std::nothrow) qmake_project();
+	if (!project)
+		return nullptr;
+
+	try
+	{
+		// Every variable is evaluated, so no slice.
+		eval_options opts;
+		opts.cache = &session->cache;
+		opts.inputs = make_inputs(params);
+		opts.qt = make_qt_props(params);
+		opts.warn = [project](std::string const & msg) {
+			project->warnings.push_back(msg);
+		};
+
+		boost::system::error_code ec;
+		if (!fs::is_regular_file(root, ec))
+			throw std::runtime_error(std::string("Cannot open project file: ") + root);
+
+		std::shared_ptr<env_t> env = std::make_shared<env_t>(process_root_qmake_file(root, opts));
+		env->detach();
+		project->env = env;
+		for (auto it = project->env->begin(); it != project->env->end(); ++it)
+			project->vars.push_back(it);
+	}
+	catch (std::exception const & e)
+	{
+		project->env.reset();
+		project->vars.clear();
+		project->error = e.what();
+		if (project->error.empty())
+			project->error = "Evaluation failed";
+	}
+	catch (...)
+	{
+		project->env.reset();
+		project->vars.clear();
+		project->error = "Evaluation failed";
+	}
+	return project;
+}
+
+void qmake_project_free(qmake_project * project)
+{
+	delete project;
+}
+
+char const * qmake_project_error(qmake_project const * project)
+{
+	return project->error.empty()? nullptr: project->error.c_str();
+}
+
+size_t qmake_project_var_count(qmake_project const * project)
+{
+	return project->vars.size();
+}
+
+char const * qmake_project_var_name(qmake_project const * project, size_t index)
+{
+	return index < project->vars.size()? project->vars[index]->first.c_str(): nullptr;
+}
+
+size_t qmake_project_value_count(qmake_project const * project, char const * name)
+{
+	value_list const * values = find_values(project, name);
+	return values? values->size(): 0;
+}
+
+char const * qmake_project_value(qmake_project const * project, char const * name, size_t index)
+{
+	value_list const * values = find_values(project, name);
+	return values && index < values->size()? (*values)[index].c_str(): nullptr;
+}
+
+size_t qmake_project_warning_count(qmake_project const * project)
+{
+	return project->warnings.size();
+}
+
+char const * qmake_project_warning(qmake_project const * project, size_t index)
+{
+	return index < project->warnings.size()? project->warnings[index].c_str(): nullptr;
+}
@@ -0,0 +1,85 @@
+#ifndef QMAKE_EVAL_H
+#define QMAKE_EVAL_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+# ifdef QMAKE_EVAL_BUILD
+#  define QMAKE_EVAL_API __declspec(dllexport)
+# else
+#  define QMAKE_EVAL_API __declspec(dllimport)
+# endif
+#else
+# define QMAKE_EVAL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Evaluates .pro files in-process.
+//
+// A session owns the parsed files, the directory listings and the projects
+// evaluated for infile() and is shared by every project loaded through it;
+// all functions may be called from any number of threads at once. Loaded
+// projects are immutable and stay valid until freed, even after their
+// session is destroyed. Strings are UTF-8 and owned by the library.
+
+typedef struct qmake_session qmake_session;
+typedef struct qmake_project qmake_project;
+
+typedef struct qmake_eval_params
+{
+	// Values appended to the default CONFIG.
+	char const * const * config;
+	size_t config_count;
+
+	// "NAME=value" pairs returned by $$(NAME).
+	char const * const * environment;
+	size_t environment_count;
+
+	// If zero, $$(NAME) is empty for names not listed in `environment`
+	// instead of falling back to the process environment.
+	int inherit_environment;
+
+	// "NAME=value" pairs returned by $$[NAME]. QT_INSTALL_HEADERS and
+	// QT_INSTALL_LIBS also set the Qt paths of the evaluated project.
+	char const * const * properties;
+	size_t properties_count;
+} qmake_eval_params;
+
+QMAKE_EVAL_API qmake_session * qmake_session_create(void);
+QMAKE_EVAL_API void qmake_session_destroy(qmake_session * session);
+
+// Forgets the parsed files and directory listings seen so far, e.g. after
+// the source tree has changed. Other sessions and projects already loaded
+// are not affected.
+QMAKE_EVAL_API void qmake_session_reset(qmake_session * session);
+
+// Evaluates a root project; `params` may be null. Never returns null
+// except when out of memory; check qmake_project_error().
+QMAKE_EVAL_API qmake_project * qmake_project_load(qmake_session * session, char const * root, qmake_eval_params const * params);
+QMAKE_EVAL_API void qmake_project_free(qmake_project * project);
+
+// Returns null if the project was evaluated successfully.
+QMAKE_EVAL_API char const * qmake_project_error(qmake_project const * project);
+
+// Warnings about the files parsed while loading the project, e.g. unknown
+// test functions. A file is parsed once per session, so its warnings are
+// only reported by the first project to load it.
+QMAKE_EVAL_API size_t qmake_project_warning_count(qmake_project const * project);
+QMAKE_EVAL_API char const * qmake_project_warning(qmake_project const * project, size_t index);
+
+// Variables are enumerated in name order.
+QMAKE_EVAL_API size_t qmake_project_var_count(qmake_project const * project);
+QMAKE_EVAL_API char const * qmake_project_var_name(qmake_project const * project, size_t index);
+
+// Returns 0 values for an unset variable.
+QMAKE_EVAL_API size_t qmake_project_value_count(qmake_project const * project, char const * name);
+QMAKE_EVAL_API char const * qmake_project_value(qmake_project const * project, char const * name, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QMAKE_EVAL_H
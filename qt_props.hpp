@@ -0,0 +1,186 @@
+#ifndef QT_PROPS_HPP
+#define QT_PROPS_HPP
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Paths of a Qt module derived from the installation properties.
+struct qt_component
+{
+	std::string include_dir;
+	std::string debug_lib;
+	std::string release_lib;
+};
+
+// The values of $$[QT_INSTALL_*] and friends for one Qt installation.
+//
+// Properties are loaded once per run, either from a file of `NAME=value`
+// lines or from the `NAME:value` output of `qmake -query`. The per-module
+// include directories and library names are derived on first use and
+// shared by every project built against the installation.
+class qt_props
+{
+public:
+	// The installation assumed when no property file is given.
+	static std::shared_ptr<qt_props const> builtin()
+	{
+		static std::shared_ptr<qt_props const> const props = make_builtin();
+		return props;
+	}
+
+	static std::shared_ptr<qt_props const> load(std::string const & fname)
+	{
+		std::ifstream fin(fname.c_str());
+		if (!fin)
+			throw std::runtime_error("Cannot read Qt properties: " + fname);
+
+		std::shared_ptr<qt_props> res = std::make_shared<qt_props>();
+		std::string line;
+		while (std::getline(fin, line))
+		{
+			if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			// Names never contain either separator; Windows paths in the
+			// values do.
+			size_t sep = line.find_first_of(":=");
+			if (sep == std::string::npos)
+				throw std::runtime_error("Invalid Qt property in " + fname + ": " + line);
+			res->m_values[line.substr(0, sep)] = line.substr(sep + 1);
+		}
+
+		res->m_source = fname;
+		res->init();
+		return res;
+	}
+
+	// A copy of `base` with some properties replaced, e.g. ones injected
+	// by an embedding application.
+	static std::shared_ptr<qt_props const> with_overrides(qt_props const & base, std::map<std::string, std::string> const & values)
+	{
+		std::shared_ptr<qt_props> res = std::make_shared<qt_props>();
+		res->m_source = base.m_source;
+		res->m_overrides = base.m_overrides;
+		res->m_values = base.m_values;
+		for (auto it = values.begin(); it != values.end(); ++it)
+		{
+			res->m_values[it->first] = it->second;
+			res->m_overrides.append("\n").append(it->first).append("=").append(it->second);
+		}
+
+		// Overriding one of an aliased pair overrides both.
+		res->override_alias(values, "QT_INSTALL_HEADER", "QT_INSTALL_HEADERS");
+		res->override_alias(values, "QT_INSTALL_LIB", "QT_INSTALL_LIBS");
+		res->init();
+		return res;
+	}
+
+	qt_props()
+		: m_major_version(4)
+	{
+	}
+
+	// Returns nullptr for unknown properties.
+	std::string const * find(std::string const & name) const
+	{
+		auto it = m_values.find(name);
+		return it == m_values.end()? nullptr: &it->second;
+	}
+
+	// The file the properties were loaded from, if any.
+	std::string const & source() const { return m_source; }
+
+	// Identifies the installation in cache keys.
+	std::string fingerprint() const { return m_source + m_overrides; }
+
+	std::string const & include_dir() const { return m_include_dir; }
+	std::string const & lib_dir() const { return m_lib_dir; }
+
+	// `name` is a QT value, e.g. "core" or "gui".
+	qt_component const & component(std::string const & name) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_components.find(name);
+		if (it != m_components.end())
+			return it->second;
+
+		std::string module = name;
+		module[0] = ::toupper(module[0]);
+
+		qt_component c;
+		c.include_dir = m_include_dir + "/Qt" + module;
+		if (m_major_version >= 5)
+		{
+			c.debug_lib = "Qt5" + module + "d.lib";
+			c.release_lib = "Qt5" + module + ".lib";
+		}
+		else
+		{
+			c.debug_lib = "Qt" + module + "d4.lib";
+			c.release_lib = "Qt" + module + "4.lib";
+		}
+		return m_components.insert(std::make_pair(name, c)).first->second;
+	}
+
+private:
+	static std::shared_ptr<qt_props const> make_builtin()
+	{
+		std::shared_ptr<qt_props> res = std::make_shared<qt_props>();
+		res->m_values["QT_INSTALL_HEADERS"] = "c:\\QtSDK\\Desktop\\Qt\\4.8.1\\msvc2010\\include";
+		res->m_values["QT_INSTALL_LIBS"] = "c:\\QtSDK\\Desktop\\Qt\\4.8.1\\msvc2010\\lib";
+		res->m_values["QT_VERSION"] = "4.8.1";
+		res->init();
+		return res;
+	}
+
+	void init()
+	{
+		// Older .pro files use the singular names.
+		alias("QT_INSTALL_HEADER", "QT_INSTALL_HEADERS");
+		alias("QT_INSTALL_LIB", "QT_INSTALL_LIBS");
+
+		if (std::string const * v = this->find("QT_INSTALL_HEADERS"))
+			m_include_dir = *v;
+		if (std::string const * v = this->find("QT_INSTALL_LIBS"))
+			m_lib_dir = *v;
+		if (std::string const * v = this->find("QT_VERSION"))
+			m_major_version = atoi(v->c_str());
+	}
+
+	void alias(char const * name, char const * target)
+	{
+		if (m_values.find(name) == m_values.end() && m_values.find(target) != m_values.end())
+			m_values[name] = m_values[target];
+	}
+
+	void override_alias(std::map<std::string, std::string> const & values, char const * name, char const * target)
+	{
+		auto n = values.find(name);
+		auto t = values.find(target);
+		if (t != values.end() && n == values.end())
+			m_values[name] = t->second;
+		else if (n != values.end() && t == values.end())
+			m_values[target] = n->second;
+	}
+
+	std::string m_source;
+	std::string m_overrides;
+	std::unordered_map<std::string, std::string> m_values;
+	std::string m_include_dir;
+	std::string m_lib_dir;
+	int m_major_version;
+
+	mutable std::mutex m_mutex;
+	mutable std::unordered_map<std::string, qt_component> m_components;
+};
+
+#endif // QT_PROPS_HPP
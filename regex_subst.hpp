@@ -0,0 +1,322 @@
+#ifndef REGEX_SUBST_HPP
+#define REGEX_SUBST_HPP
+
+#include <boost/regex.hpp>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A compiled `s/pattern/replacement/flags` expression as used by the ~=
+// operator.
+//
+// Most .pro files only substitute fixed strings, possibly anchored to the
+// start or end of the value. Such patterns are recognized at compile time
+// and applied with plain string comparisons; everything else goes through
+// boost::regex. Replacements may refer to groups as \1..\9 and are split
+// into literal and group parts once, when compiled.
+class regex_subst
+{
+public:
+	static std::shared_ptr<regex_subst const> compile(std::string const & expr)
+	{
+		if (expr.size() < 2 || expr[0] != 's')
+			throw std::runtime_error("Invalid substitution: " + expr);
+
+		char delim = expr[1];
+		std::vector<std::string> parts;
+		parts.push_back(std::string());
+		for (size_t i = 2; i < expr.size(); ++i)
+		{
+			if (expr[i] == '\\' && i + 1 < expr.size())
+			{
+				// Escaped delimiters lose their backslash, other escapes are
+				// left for the pattern and replacement parsers.
+				if (expr[i + 1] != delim)
+					parts.back().push_back('\\');
+				parts.back().push_back(expr[i + 1]);
+				++i;
+			}
+			else if (expr[i] == delim && parts.size() < 3)
+			{
+				parts.push_back(std::string());
+			}
+			else
+			{
+				parts.back().push_back(expr[i]);
+			}
+		}
+
+		if (parts.size() < 2)
+			throw std::runtime_error("Invalid substitution: " + expr);
+
+		std::shared_ptr<regex_subst> res = compile(parts[0], parts[1], parts.size() > 2? parts[2]: std::string());
+		res->m_source = expr;
+		return res;
+	}
+
+	static std::shared_ptr<regex_subst> compile(std::string const & pattern, std::string const & replacement, std::string const & flags)
+	{
+		std::shared_ptr<regex_subst> res = std::make_shared<regex_subst>();
+		res->m_global = flags.find('g') != std::string::npos;
+		bool icase = flags.find('i') != std::string::npos;
+
+		res->parse_replacement(replacement);
+
+		if (icase || res->m_max_group >= 0 || !res->parse_literal(pattern))
+		{
+			boost::regex::flag_type re_flags = boost::regex::perl;
+			if (icase)
+				re_flags |= boost::regex::icase;
+			res->m_kind = k_regex;
+			res->m_re.assign(pattern, re_flags);
+			if (res->m_max_group > (int)res->m_re.mark_count())
+				throw std::runtime_error("Invalid back reference in substitution: " + pattern + " -> " + replacement);
+		}
+
+		return res;
+	}
+
+	// Compiles a global substitution as used by $$replace(), remembering
+	// the most recent distinct pattern/replacement pairs. The cache is
+	// shared by every session in the process, so it is emptied whenever
+	// it fills up rather than growing with each generated pattern.
+	static std::shared_ptr<regex_subst const> compile_cached(std::string const & pattern, std::string const & replacement)
+	{
+		static size_t const max_entries = 1024;
+		static std::mutex mutex;
+		static std::map<std::pair<std::string, std::string>, std::shared_ptr<regex_subst const> > cache;
+
+		std::pair<std::string, std::string> key(pattern, replacement);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = cache.find(key);
+			if (it != cache.end())
+				return it->second;
+		}
+
+		std::shared_ptr<regex_subst const> res = compile(pattern, replacement, "g");
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (cache.size() >= max_entries)
+			cache.clear();
+		return cache.insert(std::make_pair(key, res)).first->second;
+	}
+
+	regex_subst()
+		: m_kind(k_regex), m_global(false), m_max_group(-1)
+	{
+	}
+
+	std::string const & source() const { return m_source; }
+
+	// Applies the substitution in place; returns true if the value changed.
+	bool apply(std::string & value) const
+	{
+		switch (m_kind)
+		{
+		case k_exact:
+			if (value != m_literal)
+				return false;
+			value = m_literal_replacement;
+			return true;
+		case k_prefix:
+			if (value.compare(0, m_literal.size(), m_literal) != 0)
+				return false;
+			value.replace(0, m_literal.size(), m_literal_replacement);
+			return true;
+		case k_suffix:
+			if (value.size() < m_literal.size() || value.compare(value.size() - m_literal.size(), m_literal.size(), m_literal) != 0)
+				return false;
+			value.replace(value.size() - m_literal.size(), m_literal.size(), m_literal_replacement);
+			return true;
+		case k_literal:
+			return this->apply_literal(value);
+		default:
+			return this->apply_regex(value);
+		}
+	}
+
+private:
+	enum kind_t { k_literal, k_prefix, k_suffix, k_exact, k_regex };
+
+	struct replacement_part
+	{
+		int group; // -1 for literal text
+		std::string text;
+	};
+
+	void parse_replacement(std::string const & r)
+	{
+		for (size_t i = 0; i < r.size(); ++i)
+		{
+			int group = -1;
+			char ch = r[i];
+			if (r[i] == '\\' && i + 1 < r.size())
+			{
+				++i;
+				ch = r[i];
+				if (ch >= '0' && ch <= '9')
+					group = ch - '0';
+			}
+
+			if (group >= 0)
+			{
+				replacement_part part;
+				part.group = group;
+				m_replacement.push_back(part);
+				if (group > m_max_group)
+					m_max_group = group;
+			}
+			else
+			{
+				if (m_replacement.empty() || m_replacement.back().group >= 0)
+				{
+					replacement_part part;
+					part.group = -1;
+					m_replacement.push_back(part);
+				}
+				m_replacement.back().text.push_back(ch);
+				m_literal_replacement.push_back(ch);
+			}
+		}
+	}
+
+	// Recognizes patterns that match a fixed string, optionally anchored.
+	bool parse_literal(std::string const & pattern)
+	{
+		static char const meta[] = ".[]()*+?{}|^$\\";
+
+		size_t first = 0;
+		size_t last = pattern.size();
+		bool anchored_start = last > 0 && pattern[0] == '^';
+		if (anchored_start)
+			++first;
+
+		bool anchored_end = last > first && pattern[last - 1] == '$' && (last < 2 || pattern[last - 2] != '\\');
+		if (anchored_end)
+			--last;
+
+		std::string literal;
+		for (size_t i = first; i < last; ++i)
+		{
+			char ch = pattern[i];
+			if (ch == '\\')
+			{
+				if (i + 1 == last || isalnum((unsigned char)pattern[i + 1]))
+					return false;
+				literal.push_back(pattern[++i]);
+			}
+			else if (strchr(meta, ch))
+			{
+				return false;
+			}
+			else
+			{
+				literal.push_back(ch);
+			}
+		}
+
+		if (literal.empty() && !(anchored_start && anchored_end))
+			return false;
+
+		m_literal = literal;
+		m_kind = anchored_start? (anchored_end? k_exact: k_prefix): anchored_end? k_suffix: k_literal;
+		return true;
+	}
+
+	bool apply_literal(std::string & value) const
+	{
+		size_t pos = value.find(m_literal);
+		if (pos == std::string::npos)
+			return false;
+
+		if (!m_global)
+		{
+			value.replace(pos, m_literal.size(), m_literal_replacement);
+			return true;
+		}
+
+		std::string res;
+		res.reserve(value.size());
+		size_t last = 0;
+		while (pos != std::string::npos)
+		{
+			res.append(value, last, pos - last);
+			res.append(m_literal_replacement);
+			last = pos + m_literal.size();
+			pos = value.find(m_literal, last);
+		}
+		res.append(value, last, std::string::npos);
+		value.swap(res);
+		return true;
+	}
+
+	bool apply_regex(std::string & value) const
+	{
+		std::string res;
+		bool changed = false;
+
+		std::string::const_iterator first = value.begin();
+		std::string::const_iterator last = value.end();
+		boost::match_flag_type match_flags = boost::match_default;
+		boost::smatch m;
+		while (boost::regex_search(first, last, m, m_re, match_flags))
+		{
+			changed = true;
+			res.append(first, m[0].first);
+			for (size_t i = 0; i < m_replacement.size(); ++i)
+			{
+				replacement_part const & part = m_replacement[i];
+				if (part.group < 0)
+					res.append(part.text);
+				else
+					res.append(m[part.group].first, m[part.group].second);
+			}
+
+			if (m[0].first == m[0].second)
+			{
+				// Empty match; copy one character to make progress.
+				if (m[0].second == last)
+				{
+					first = last;
+					break;
+				}
+				res.push_back(*m[0].second);
+				first = m[0].second + 1;
+			}
+			else
+			{
+				first = m[0].second;
+			}
+
+			match_flags |= boost::match_prev_avail | boost::match_not_bol;
+			if (!m_global)
+				break;
+		}
+
+		if (!changed)
+			return false;
+
+		res.append(first, last);
+		value.swap(res);
+		return true;
+	}
+
+	std::string m_source;
+	kind_t m_kind;
+	bool m_global;
+
+	std::string m_literal;
+	std::string m_literal_replacement;
+
+	boost::regex m_re;
+	std::vector<replacement_part> m_replacement;
+	int m_max_group; // -1 if the replacement has no group references
+};
+
+#endif // REGEX_SUBST_HPP
@@ -0,0 +1,152 @@
+#ifndef RESOLVE_HPP
+#define RESOLVE_HPP
+
+#include "ast.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+// Resolves the test function of a condition into an opcode and pre-parses
+// its constant operands, so that evaluation doesn't have to compare
+// function names or split option lists.
+inline void resolve_condition(cond & c)
+{
+	fncall const & call = c.call;
+	size_t argc = call.args.size();
+
+	if (call.fn == "else" && argc == 0)
+	{
+		c.op = cond::op_else;
+	}
+	else if (argc == 0 || (call.fn == "CONFIG" && argc == 1))
+	{
+		c.op = cond::op_config;
+	}
+	else if (call.fn == "CONFIG" && argc == 2)
+	{
+		c.op = cond::op_config_choice;
+
+		std::string const & u = call.args[1];
+		size_t start = 0;
+		size_t pos = u.find('|');
+		while (pos != std::string::npos)
+		{
+			c.options.push_back(u.substr(start, pos - start));
+			start = pos + 1;
+			pos = u.find('|', start);
+		}
+		c.options.push_back(u.substr(start));
+
+		std::sort(c.options.begin(), c.options.end());
+		c.options.erase(std::unique(c.options.begin(), c.options.end()), c.options.end());
+	}
+	else if (call.fn == "isEmpty" && argc == 1)
+	{
+		c.op = cond::op_isempty;
+	}
+	else if (call.fn == "contains" && argc == 2)
+	{
+		c.op = cond::op_contains;
+	}
+	else if (call.fn == "infile" && argc == 3)
+	{
+		c.op = cond::op_infile;
+	}
+	else if (call.fn == "exists" && argc == 1)
+	{
+		c.op = cond::op_exists;
+	}
+	else if (call.fn == "count" && (argc == 2 || argc == 3))
+	{
+		c.op = cond::op_count;
+		c.number = strtoul(call.args[1].c_str(), nullptr, 10);
+		std::string const & cmp = argc == 3? call.args[2]: std::string();
+		c.compare = cmp == "greaterThan" || cmp == ">"? '>': cmp == "lessThan" || cmp == "<"? '<': '=';
+	}
+	else if (call.fn == "equals" && argc == 2)
+	{
+		c.op = cond::op_equals;
+	}
+	else
+	{
+		c.op = cond::op_unknown;
+	}
+}
+
+// The replace functions env_t::call_replace_function implements.
+inline bool is_replace_function(std::string const & fn)
+{
+	static char const * const names[] = {
+		"basename", "dirname", "escape_expand", "files", "join", "quote", "replace", "split", "unique"
+	};
+	for (size_t i = 0; i < sizeof names / sizeof names[0]; ++i)
+	{
+		if (fn == names[i])
+			return true;
+	}
+	return false;
+}
+
+// Adds "replace function NAME" to `unknown` for every call of an unknown
+// replace function in `s`.
+inline void collect_replace_calls(std::string const & s, std::set<std::string> & unknown)
+{
+	size_t pos = s.find("$$");
+	while (pos != std::string::npos)
+	{
+		size_t first = pos + 2;
+		size_t last = first;
+		while (last < s.size() && (isalnum((unsigned char)s[last]) || s[last] == '_'))
+			++last;
+
+		if (last != first && last < s.size() && s[last] == '(')
+		{
+			std::string fn = s.substr(first, last - first);
+			if (!is_replace_function(fn))
+				unknown.insert("replace function " + fn);
+		}
+		pos = s.find("$$", first);
+	}
+}
+
+inline void collect_replace_calls(std::vector<std::string> const & values, std::set<std::string> & unknown)
+{
+	for (size_t i = 0; i < values.size(); ++i)
+		collect_replace_calls(values[i], unknown);
+}
+
+// Resolves every condition in a freshly parsed file and adds unknown test
+// and replace functions to `unknown`, as "test function NAME" and
+// "replace function NAME", so that the caller can report them even if the
+// branch using them is never taken. Evaluating an unknown test function is
+// still an error; an unknown replace function call is kept as written.
+inline void resolve_conditions(block_stmt & b, std::set<std::string> & unknown)
+{
+	for (size_t i = 0; i < b.stmts.size(); ++i)
+	{
+		cond_stmt & cs = b.stmts[i];
+		for (size_t j = 0; j < cs.c.size(); ++j)
+		{
+			for (size_t k = 0; k < cs.c[j].size(); ++k)
+			{
+				cond & c = cs.c[j][k];
+				resolve_condition(c);
+				if (c.op == cond::op_unknown)
+					unknown.insert("test function " + c.call.fn);
+				collect_replace_calls(c.call.args, unknown);
+			}
+		}
+
+		if (block_stmt * nested = dynamic_cast<block_stmt *>(cs.s.get()))
+			resolve_conditions(*nested, unknown);
+		else if (var_stmt const * v = dynamic_cast<var_stmt const *>(cs.s.get()))
+			collect_replace_calls(v->ident_list, unknown);
+		else if (fncall_stmt const * fc = dynamic_cast<fncall_stmt const *>(cs.s.get()))
+			collect_replace_calls(fc->call.args, unknown);
+	}
+}
+
+#endif // RESOLVE_HPP
@@ -0,0 +1,312 @@
+#ifndef SLICE_HPP
+#define SLICE_HPP
+
+#include "ast.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <cctype>
+
+// Tracks which variables can influence the generated output and answers
+// whether a statement has to be evaluated at all.
+//
+// Every parsed file is summarized statement by statement: for each
+// assignment or function call we record the variables the statement reads
+// and the variables read by the conditions guarding it (including the
+// conditions an `else` depends on). A variable is relevant if it is
+// a generator input or if a relevant assignment or any function call reads
+// it, directly or through its guard. Assignments to irrelevant variables, and conditions
+// that only guard such assignments, are skipped during evaluation.
+//
+// The set only grows as more files are seen, so an environment records the
+// variables it skipped; if any of them later becomes relevant, the caller
+// must evaluate the root again.
+//
+// A slice may be shared by roots evaluated concurrently. Updates lock;
+// evaluation only reads an immutable snapshot of the relevant set, which
+// readers take again when version() changes. A stale snapshot is a subset
+// of the current set, so it can only make a reader skip too much, which
+// the skipped-variable check catches, provided that every else-chain is
+// decided against one snapshot; env_t takes one per block.
+class slice_t
+{
+public:
+	typedef std::shared_ptr<std::set<std::string> const> snapshot_t;
+
+	explicit slice_t(std::vector<std::string> const & outputs)
+		: m_version(0)
+	{
+		for (size_t i = 0; i < outputs.size(); ++i)
+			this->make_relevant(outputs[i]);
+	}
+
+	void add_file(std::string const & fname, block_stmt const & b)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_files.insert(fname).second)
+			return;
+
+		std::set<std::string> guard;
+		this->add_block_facts(b, guard);
+	}
+
+	bool knows_file(std::string const & fname) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_files.find(fname) != m_files.end();
+	}
+
+	// Adds statements of a file that is being streamed. The caller checks
+	// knows_file before the first part and calls add_file at the end.
+	void add_file_part(block_stmt const & b)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::set<std::string> guard;
+		this->add_block_facts(b, guard);
+	}
+
+	uint64_t version() const
+	{
+		return m_version.load(std::memory_order_acquire);
+	}
+
+	snapshot_t snapshot(uint64_t & version) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		version = m_version.load(std::memory_order_relaxed);
+		if (!m_snapshot)
+			m_snapshot = std::make_shared<std::set<std::string> const>(m_relevant);
+		return m_snapshot;
+	}
+
+	bool any_relevant(std::set<std::string> const & names) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it = names.begin(); it != names.end(); ++it)
+		{
+			if (this->contains(*it))
+				return true;
+		}
+		return false;
+	}
+
+	// The condition of the i-th statement must be evaluated if the statement
+	// itself is live or if a following `else` depends on its outcome.
+	static bool needs_condition(std::set<std::string> const & relevant, block_stmt const & b, size_t i)
+	{
+		for (; i < b.stmts.size(); ++i)
+		{
+			if (live(relevant, b.stmts[i].s.get()))
+				return true;
+			if (i + 1 == b.stmts.size() || !uses_else(b.stmts[i + 1]))
+				return false;
+		}
+		return false;
+	}
+
+	static bool uses_else(cond_stmt const & cs)
+	{
+		for (size_t i = 0; i < cs.c.size(); ++i)
+		{
+			for (size_t j = 0; j < cs.c[i].size(); ++j)
+			{
+				if (cs.c[i][j].call.fn == "else" && cs.c[i][j].call.args.empty())
+					return true;
+			}
+		}
+		return false;
+	}
+
+	static void collect_assigned(stmt const * s, std::set<std::string> & names)
+	{
+		if (block_stmt const * b = dynamic_cast<block_stmt const *>(s))
+		{
+			for (size_t i = 0; i < b->stmts.size(); ++i)
+				collect_assigned(b->stmts[i].s.get(), names);
+		}
+		else if (var_stmt const * v = dynamic_cast<var_stmt const *>(s))
+		{
+			names.insert(v->name);
+		}
+	}
+
+	static void collect_var_refs(std::string const & s, std::set<std::string> & refs)
+	{
+		size_t pos = s.find("$$");
+		while (pos != std::string::npos)
+		{
+			size_t first = pos + 2;
+			bool braced = first < s.size() && s[first] == '{';
+			if (braced)
+				++first;
+
+			size_t last = first;
+			while (last < s.size() && (isalnum((unsigned char)s[last]) || s[last] == '_'))
+				++last;
+
+			if (last != first && !braced && last != s.size() && s[last] == '(')
+			{
+				// Replace functions take variable names as plain arguments;
+				// treat every word inside the call as a potential one.
+				int depth = 0;
+				size_t word = std::string::npos;
+				for (; last < s.size(); ++last)
+				{
+					bool word_char = isalnum((unsigned char)s[last]) || s[last] == '_';
+					if (word_char && word == std::string::npos)
+						word = last;
+					else if (!word_char && word != std::string::npos)
+					{
+						refs.insert(s.substr(word, last - word));
+						word = std::string::npos;
+					}
+
+					if (s[last] == '(')
+						++depth;
+					else if (s[last] == ')' && --depth == 0)
+						break;
+				}
+
+				// Nested $$ references are picked up by the outer loop.
+				last = first;
+			}
+			else if (last != first)
+			{
+				refs.insert(s.substr(first, last - first));
+			}
+
+			pos = s.find("$$", last);
+		}
+	}
+
+	static bool live(std::set<std::string> const & relevant, stmt const * s)
+	{
+		if (block_stmt const * b = dynamic_cast<block_stmt const *>(s))
+		{
+			for (size_t i = 0; i < b->stmts.size(); ++i)
+			{
+				if (live(relevant, b->stmts[i].s.get()))
+					return true;
+			}
+			return false;
+		}
+
+		if (var_stmt const * v = dynamic_cast<var_stmt const *>(s))
+			return relevant.find(v->name) != relevant.end();
+
+		return true;
+	}
+
+private:
+	bool contains(std::string const & name) const
+	{
+		return m_relevant.find(name) != m_relevant.end();
+	}
+
+	static void collect_cond_refs(std::vector<std::vector<cond> > const & cond_list, std::set<std::string> & refs)
+	{
+		for (size_t i = 0; i < cond_list.size(); ++i)
+		{
+			for (size_t j = 0; j < cond_list[i].size(); ++j)
+			{
+				fncall const & call = cond_list[i][j].call;
+				if (call.fn == "else" && call.args.empty())
+					continue;
+
+				if (call.args.empty() || call.fn == "CONFIG")
+					refs.insert("CONFIG");
+
+				// Test functions take variable names as plain arguments;
+				// treat every argument as a potential one.
+				for (size_t k = 0; k < call.args.size(); ++k)
+				{
+					refs.insert(call.args[k]);
+					collect_var_refs(call.args[k], refs);
+				}
+			}
+		}
+	}
+
+	void add_block_facts(block_stmt const & b, std::set<std::string> const & outer_guard)
+	{
+		std::set<std::string> chain;
+		for (size_t i = 0; i < b.stmts.size(); ++i)
+		{
+			cond_stmt const & cs = b.stmts[i];
+			if (!uses_else(cs))
+				chain.clear();
+			collect_cond_refs(cs.c, chain);
+
+			std::set<std::string> guard(outer_guard);
+			guard.insert(chain.begin(), chain.end());
+
+			if (block_stmt const * nested = dynamic_cast<block_stmt const *>(cs.s.get()))
+			{
+				this->add_block_facts(*nested, guard);
+			}
+			else if (var_stmt const * v = dynamic_cast<var_stmt const *>(cs.s.get()))
+			{
+				for (size_t j = 0; j < v->ident_list.size(); ++j)
+					collect_var_refs(v->ident_list[j], guard);
+
+				if (this->contains(v->name))
+					this->make_relevant(guard);
+				else
+					m_pending[v->name].push_back(guard);
+			}
+			else if (fncall_stmt const * fc = dynamic_cast<fncall_stmt const *>(cs.s.get()))
+			{
+				for (size_t j = 0; j < fc->call.args.size(); ++j)
+					collect_var_refs(fc->call.args[j], guard);
+				this->make_relevant(guard);
+			}
+		}
+	}
+
+	void make_relevant(std::string const & name)
+	{
+		std::vector<std::string> worklist(1, name);
+		while (!worklist.empty())
+		{
+			std::string cur;
+			cur.swap(worklist.back());
+			worklist.pop_back();
+
+			if (!m_relevant.insert(cur).second)
+				continue;
+
+			m_snapshot.reset();
+			m_version.fetch_add(1, std::memory_order_release);
+
+			auto it = m_pending.find(cur);
+			if (it == m_pending.end())
+				continue;
+
+			for (size_t i = 0; i < it->second.size(); ++i)
+				worklist.insert(worklist.end(), it->second[i].begin(), it->second[i].end());
+			m_pending.erase(it);
+		}
+	}
+
+	void make_relevant(std::set<std::string> const & names)
+	{
+		for (auto it = names.begin(); it != names.end(); ++it)
+			this->make_relevant(*it);
+	}
+
+	mutable std::mutex m_mutex;
+	std::set<std::string> m_files;
+	std::set<std::string> m_relevant;
+	std::atomic<uint64_t> m_version;
+	mutable snapshot_t m_snapshot; // built on demand
+
+	// Reads of assignments to variables not (yet) known to be relevant.
+	std::map<std::string, std::vector<std::set<std::string> > > m_pending;
+};
+
+#endif // SLICE_HPP
@@ -0,0 +1,229 @@
+#include "stats.hpp"
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+std::atomic<bool> g_stats_enabled(false);
+thread_local uint64_t g_thread_stats[stat_count];
+std::atomic<uint64_t> g_run_stats[stat_count];
+
+static char const * const stat_names[stat_count] = {
+	"statements",
+	"cond_else",
+	"cond_config",
+	"cond_isEmpty",
+	"cond_contains",
+	"cond_infile",
+	"cond_exists",
+	"cond_count",
+	"cond_equals",
+	"translate_calls",
+	"translate_bytes",
+	"var_reads",
+	"var_writes",
+	"allocs",
+	"alloc_bytes",
+	"parse_us",
+	"eval_us",
+	"generate_us",
+	"wall_us",
+};
+
+namespace {
+
+struct project_stats
+{
+	project_stats()
+	{
+		for (size_t i = 0; i < stat_count; ++i)
+			values[i] = 0;
+	}
+
+	uint64_t values[stat_count];
+};
+
+std::mutex & project_stats_mutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+// Keyed by project file; batches evaluate thousands of roots.
+std::map<std::string, project_stats> & project_stats_map()
+{
+	static std::map<std::string, project_stats> projects;
+	return projects;
+}
+
+}
+
+stats_scope::stats_scope(std::string const & project)
+{
+	if (!g_stats_enabled.load(std::memory_order_relaxed))
+		return;
+
+	m_project = project;
+	for (size_t i = 0; i < stat_count; ++i)
+		m_start[i] = g_thread_stats[i];
+}
+
+stats_scope::~stats_scope()
+{
+	if (m_project.empty())
+		return;
+
+	uint64_t values[stat_count];
+	for (size_t i = 0; i < stat_count; ++i)
+		values[i] = g_thread_stats[i] - m_start[i];
+
+	std::lock_guard<std::mutex> lock(project_stats_mutex());
+	project_stats & ps = project_stats_map()[m_project];
+	for (size_t i = 0; i < stat_count; ++i)
+		ps.values[i] += values[i];
+}
+
+static thread_local unsigned g_timer_depth[stat_count];
+
+stat_timer::stat_timer(stat_t s)
+	: m_stat(s), m_enabled(g_stats_enabled.load(std::memory_order_relaxed)), m_outermost(m_enabled && g_timer_depth[s]++ == 0)
+{
+	if (m_outermost)
+		m_start = std::chrono::steady_clock::now();
+}
+
+stat_timer::~stat_timer()
+{
+	if (!m_enabled)
+		return;
+
+	--g_timer_depth[m_stat];
+	if (m_outermost)
+		count_stat(m_stat, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count());
+}
+
+static void write_json_string(std::ostream & out, std::string const & s)
+{
+	static char const hex[] = "0123456789abcdef";
+
+	out << '"';
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		unsigned char ch = s[i];
+		if (ch == '"' || ch == '\\')
+			out << '\\' << ch;
+		else if (ch < 0x20)
+			out << "\\u00" << hex[ch >> 4] << hex[ch & 0xf];
+		else
+			out << ch;
+	}
+	out << '"';
+}
+
+static void write_json_counters(std::ostream & out, uint64_t const * values, char const * indent)
+{
+	out << "{\n";
+	for (size_t i = 0; i < stat_count; ++i)
+		out << indent << "  \"" << stat_names[i] << "\": " << values[i] << (i + 1 == stat_count? "\n": ",\n");
+	out << indent << "}";
+}
+
+void write_stats_json(std::ostream & out)
+{
+	uint64_t totals[stat_count];
+	for (size_t i = 0; i < stat_count; ++i)
+		totals[i] = g_run_stats[i].load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(project_stats_mutex());
+	std::map<std::string, project_stats> const & projects = project_stats_map();
+
+	out << "{\n  \"run\": ";
+	write_json_counters(out, totals, "  ");
+	out << ",\n  \"projects\": [";
+	for (auto it = projects.begin(); it != projects.end(); ++it)
+	{
+		out << (it == projects.begin()? "\n": ",\n") << "    {\n      \"file\": ";
+		write_json_string(out, it->first);
+		out << ",\n      \"counters\": ";
+		write_json_counters(out, it->second.values, "      ");
+		out << "\n    }";
+	}
+	out << (projects.empty()? "]\n": "\n  ]\n") << "}\n";
+}
+
+// Reads the counters of the "run" object; the file is in the format written
+// by write_stats_json, so every counter is on a line of its own.
+static bool read_run_stats(std::istream & in, uint64_t * values, bool * found)
+{
+	std::string line;
+	bool in_run = false;
+	while (std::getline(in, line))
+	{
+		if (line.find("\"run\"") != std::string::npos)
+		{
+			in_run = true;
+			continue;
+		}
+		if (!in_run)
+			continue;
+		if (line.find('}') != std::string::npos)
+			return true;
+
+		for (size_t i = 0; i < stat_count; ++i)
+		{
+			std::string key = std::string("\"") + stat_names[i] + "\":";
+			size_t pos = line.find(key);
+			if (pos != std::string::npos)
+			{
+				values[i] = strtoull(line.c_str() + pos + key.size(), nullptr, 10);
+				found[i] = true;
+			}
+		}
+	}
+	return false;
+}
+
+// Counters that only depend on the input and on what the tool does with
+// it. Allocations vary with the standard library and translated bytes
+// with the length of the paths the projects live at.
+static bool is_work_counter(size_t s)
+{
+	switch (s)
+	{
+	case stat_translate_bytes:
+	case stat_allocs:
+	case stat_alloc_bytes:
+	case stat_parse_us:
+	case stat_eval_us:
+	case stat_generate_us:
+	case stat_wall_us:
+		return false;
+	default:
+		return true;
+	}
+}
+
+bool check_stats_regression(std::istream & baseline, double max_percent, std::ostream & report)
+{
+	uint64_t base[stat_count] = {};
+	bool found[stat_count] = {};
+	if (!read_run_stats(baseline, base, found))
+	{
+		report << "Invalid stats baseline" << std::endl;
+		return false;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < stat_count; ++i)
+	{
+		if (!found[i] || !is_work_counter(i))
+			continue;
+
+		uint64_t cur = g_run_stats[i].load(std::memory_order_relaxed);
+		if (cur > base[i] * (1 + max_percent / 100))
+		{
+			report << stat_names[i] << " regressed: " << base[i] << " -> " << cur << " (+" << (base[i]? (cur - base[i]) * 100.0 / base[i]: 100.0) << "%)" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Operation counters reported by --stats.
+//
+// Counting is off unless enabled; when it is, every counter is bumped both
+// in a per-thread array, used to attribute work to the project being
+// evaluated on that thread, and in process-wide totals. Heap allocations
+// are counted by the replacement operator new in stats_alloc.cpp.
+enum stat_t
+{
+	stat_statements,
+	stat_cond_else,
+	stat_cond_config,
+	stat_cond_isempty,
+	stat_cond_contains,
+	stat_cond_infile,
+	stat_cond_exists,
+	stat_cond_count,
+	stat_cond_equals,
+	stat_translate_calls,
+	stat_translate_bytes,
+	stat_var_reads,
+	stat_var_writes,
+	stat_allocs,
+	stat_alloc_bytes,
+
+	// Microseconds spent parsing, evaluating (including parsing) and
+	// generating output, and in the whole run.
+	stat_parse_us,
+	stat_eval_us,
+	stat_generate_us,
+	stat_wall_us,
+
+	stat_count
+};
+
+// Normally set while parsing the command line, before any thread starts;
+// it is atomic so that toggling it later is not a data race. Scopes and
+// timers that started while counting was off stay uncounted.
+extern std::atomic<bool> g_stats_enabled;
+extern thread_local uint64_t g_thread_stats[stat_count];
+extern std::atomic<uint64_t> g_run_stats[stat_count];
+
+inline void count_stat(stat_t s, uint64_t n = 1)
+{
+	if (!g_stats_enabled.load(std::memory_order_relaxed))
+		return;
+	g_thread_stats[s] += n;
+	g_run_stats[s].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Attributes everything counted on the current thread during its lifetime
+// to `project`. Scopes nest; the counts of a nested project (e.g. one
+// evaluated by infile()) are included in the enclosing one as well.
+class stats_scope
+{
+public:
+	explicit stats_scope(std::string const & project);
+	~stats_scope();
+
+private:
+	stats_scope(stats_scope const &);
+	stats_scope & operator=(stats_scope const &);
+
+	std::string m_project;
+	uint64_t m_start[stat_count];
+};
+
+// Adds the time spent during its lifetime to one of the *_us counters.
+// Only the outermost timer of each kind on a thread counts, so that the
+// evaluation of nested projects is not counted twice.
+class stat_timer
+{
+public:
+	explicit stat_timer(stat_t s);
+	~stat_timer();
+
+private:
+	stat_timer(stat_timer const &);
+	stat_timer & operator=(stat_timer const &);
+
+	stat_t m_stat;
+	bool m_enabled;
+	bool m_outermost;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+void write_stats_json(std::ostream & out);
+
+// Compares the run's work counters with those in `baseline`, a file in the
+// format written by write_stats_json. Timings, allocations and translated
+// bytes depend on the host, so only the other counters are compared; a
+// counter missing from the baseline is not checked. Reports every counter
+// that grew by more than `max_percent` to `report` and returns false if
+// there was any.
+bool check_stats_regression(std::istream & baseline, double max_percent, std::ostream & report);
+
+#endif // STATS_HPP
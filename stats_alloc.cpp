@@ -0,0 +1,62 @@
+#include "stats.hpp"
+#include <cstdlib>
+#include <new>
+
+// Counting allocator hook. The array and nothrow forms of operator new
+// forward to these by default, so replacing them covers those as well.
+// Only the executable links this file; the library must not replace its
+// host's allocator.
+void * operator new(size_t size)
+{
+	count_stat(stat_allocs);
+	count_stat(stat_alloc_bytes, size);
+
+	void * p = malloc(size? size: 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+	free(p);
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned types; compilers without C++17 aligned new never call these.
+void * operator new(size_t size, std::align_val_t align)
+{
+	count_stat(stat_allocs);
+	count_stat(stat_alloc_bytes, size);
+
+	size_t alignment = static_cast<size_t>(align);
+#ifdef _MSC_VER
+	void * p = _aligned_malloc(size? size: 1, alignment);
+#else
+	// aligned_alloc wants a multiple of the alignment.
+	void * p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment + (size? 0: alignment));
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void operator delete(void * p, std::size_t, std::align_val_t align) noexcept
+{
+	operator delete(p, align);
+}
+#endif
@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = capi
+QT = core
+
+SOURCES = $$files(*.cpp)
+injected: DEFINES += HAS_INJECTED
+DEFINES += ENV_$$(CAPI_VAR)
+# The process environment is not inherited.
+INHERITED = $$(PATH)
+HEADERS_DIR = $$[QT_INSTALL_HEADERS]
+SUBST = capi_value
+SUBST ~= s/^capi_/CAPI_/
+
+# Reported when the file is loaded and kept as literal text.
+UNKNOWN = $$unknown_replace_function(x)
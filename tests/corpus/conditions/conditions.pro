@@ -0,0 +1,39 @@
+TEMPLATE = app
+TARGET = conditions
+QT =
+
+MODE = fast
+LEVELS = 1 2 3
+
+contains(MODE, fast): DEFINES += FAST_MODE
+!contains(MODE, fast): DEFINES += SLOW_MODE
+isEmpty(MODE): DEFINES += NO_MODE
+!isEmpty(MODE): DEFINES += HAS_MODE
+equals(MODE, fast): DEFINES += EQUALS_FAST
+count(LEVELS, 3): DEFINES += THREE_LEVELS
+count(LEVELS, 2, greaterThan): DEFINES += MANY_LEVELS
+count(LEVELS, 5, lessThan): DEFINES += FEW_LEVELS
+
+# *= only adds values that aren't there yet.
+DEFINES *= FAST_MODE UNIQUE_ONCE
+DEFINES *= UNIQUE_ONCE
+
+CONFIG(debug, debug|release): DEFINES += CFG_DEBUG
+CONFIG(release, debug|release): DEFINES += CFG_RELEASE
+win32: SOURCES += src/win.cpp
+unix: SOURCES += src/unix.cpp
+unix|win32: SOURCES += src/portable.cpp
+win32:debug: DEFINES += WIN_DEBUG
+win32:!debug: DEFINES += WIN_RELEASE
+exists(src/main.cpp): SOURCES += src/main.cpp
+exists(src/missing.cpp): SOURCES += src/missing.cpp
+
+debug {
+	DEFINES += DEBUG_BLOCK
+	contains(MODE, fast) {
+		DEFINES += NESTED_FAST
+	}
+}
+
+# Assignments nothing reads are sliced away.
+UNUSED = $$MODE unused
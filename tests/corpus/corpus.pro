@@ -0,0 +1,2 @@
+TEMPLATE = subdirs
+SUBDIRS = conditions else_chains includes infile gen_dirs pch substitutions functions
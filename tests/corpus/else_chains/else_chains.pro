@@ -0,0 +1,33 @@
+TEMPLATE = app
+TARGET = else_chains
+QT =
+
+PLATFORM = arm
+
+equals(PLATFORM, x86) {
+	DEFINES += ARCH_X86
+} else:equals(PLATFORM, arm) {
+	DEFINES += ARCH_ARM
+} else {
+	DEFINES += ARCH_OTHER
+}
+
+release {
+	DEFINES += BLOCK_RELEASE
+} else {
+	DEFINES += BLOCK_NOT_RELEASE
+}
+
+contains(PLATFORM, x86): SOURCES += x86.cpp
+else: SOURCES += generic.cpp
+
+isEmpty(PLATFORM): DEFINES += NO_PLATFORM
+else:contains(PLATFORM, arm): DEFINES += PLATFORM_ARM
+else: DEFINES += PLATFORM_SET
+
+# The else depends on OPT even though nothing else reads it.
+OPT = on
+equals(OPT, off): DEFINES += OPT_OFF
+else: DEFINES += OPT_ON
+
+SOURCES += main.cpp
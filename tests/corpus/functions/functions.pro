@@ -0,0 +1,23 @@
+TEMPLATE = app
+TARGET = functions
+QT =
+
+# Globs are relative to the project directory.
+SOURCES = $$files(src/*.cpp)
+HEADERS = $$files(include/*.h) $$files(src/*.h, true)
+SOURCES += $$files(src/sub/*.cpp, true)
+NOTHING = $$files(src/*.none)
+isEmpty(NOTHING): DEFINES += NO_MATCHES
+
+PARTS = one two three
+DEFINES += $$join(PARTS)
+DEFINES += $$join(PARTS, _)
+DEFINES += $$join(PARTS, _, BEGIN_, _END)
+EMPTY =
+DEFINES += $$join(EMPTY, _, BEGIN_, _END)
+
+PARTS_LIST = a;b;c
+SPLIT = $$split(PARTS_LIST, ;)
+DEFINES += $$SPLIT
+DEFINES += $$basename(SOURCES)
+DEFINES += $$unique(PARTS)
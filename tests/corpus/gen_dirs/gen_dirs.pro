@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = gen_dirs
+QT += core gui
+CONFIG += qt
+
+MOC_DIR = generated/moc
+UI_DIR = generated/ui
+RCC_DIR = generated/rcc
+OBJECTS_DIR = build/obj
+DESTDIR = build/bin
+
+SOURCES += src/main.cpp src/window.cpp
+HEADERS += src/window.h
+FORMS += src/window.ui
+RESOURCES += resources.qrc
+TRANSLATIONS += gen_dirs_de.ts
+OTHER_FILES += README
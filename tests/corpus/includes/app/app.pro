@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = app
+QT = core
+
+include(../shared/common.pri)
+include(../lib/lib.pri)
+
+!isEmpty(NESTED_DIR): DEFINES += HAVE_NESTED_DIR
+
+SOURCES += src/main.cpp
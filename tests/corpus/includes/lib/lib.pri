@@ -0,0 +1,3 @@
+LIB_NAME = mylib
+DEFINES += USES_$$LIB_NAME
+HEADERS += $$PWD/lib.h
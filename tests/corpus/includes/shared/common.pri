@@ -0,0 +1,3 @@
+DEFINES += COMMON
+INCLUDEPATH += $$PWD
+include(nested.pri)
@@ -0,0 +1,2 @@
+DEFINES += NESTED
+NESTED_DIR = $$PWD
@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = app
+QT =
+
+infile(../config/build.pri, LINKAGE, static): DEFINES += STATIC_LINKAGE
+infile(../config/build.pri, LINKAGE, shared): DEFINES += SHARED_LINKAGE
+infile(../config/build.pri, FEATURES, net): DEFINES += WITH_NET
+!infile(../config/build.pri, FEATURES, sql): DEFINES += WITHOUT_SQL
+
+SOURCES += main.cpp
@@ -0,0 +1,2 @@
+LINKAGE = static
+FEATURES = net gui
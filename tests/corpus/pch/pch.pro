@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = pch
+QT =
+
+PRECOMPILED_HEADER = stdafx.h
+SOURCES += src/main.cpp src/util.c
+HEADERS += stdafx.h
@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = spec
+QT = core
+
+SOURCES = src/main.cpp
+
+# Set up by the mkspec and its features.
+spec_config: DEFINES += HAS_SPEC_CONFIG
+from_default_pre: DEFINES += HAS_DEFAULT_PRE
+DEFINES += ENV_$$SPEC_ENV
+
+# From the --qt-props file.
+DEFINES += QT_$$[QT_VERSION]
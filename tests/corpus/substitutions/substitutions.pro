@@ -0,0 +1,35 @@
+TEMPLATE = app
+TARGET = substitutions
+QT =
+
+SOURCES = src/main.cpp
+
+# Fixed strings, anchored or not, are substituted without boost::regex.
+LITERAL = lit_foo_foo
+LITERAL ~= s/foo/bar/
+GLOBAL = glob_foo_foo
+GLOBAL ~= s/foo/bar/g
+PREFIX = pre_first second_pre
+PREFIX ~= s/^pre_/PRE_/
+SUFFIX = first_suf suf_second
+SUFFIX ~= s/_suf$/_SUF/
+EXACT = exact exact_not
+EXACT ~= s/^exact$/EXACT/
+ESCAPED = dot.sep
+ESCAPED ~= s/\./_/
+
+# Everything else goes through boost::regex.
+GROUPS = v1_2 v10_20
+GROUPS ~= s/v([0-9]+)_([0-9]+)/V\2_\1/
+ICASE = Mixed_Case
+ICASE ~= s/mixed/lower/i
+
+# The expression may contain spaces.
+SPACED = two_words
+SPACED ~= s/two_words/TWO WORDS/
+
+REPLACED = $$replace(LITERAL, _, -)
+REPLACED_RE = $$replace(GROUPS, ^V([0-9]+).*$, R\1)
+
+DEFINES += $$LITERAL $$GLOBAL $$PREFIX $$SUFFIX $$EXACT $$ESCAPED
+DEFINES += $$GROUPS $$ICASE $$SPACED $$REPLACED $$REPLACED_RE
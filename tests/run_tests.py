@@ -0,0 +1,405 @@
+#!/usr/bin/env python3
+# Differential test of the project generator.
+#
+# Copies corpus/ to a temporary directory, runs the tool there and compares
+# every file it generates with the file of the same path under golden/<run>/.
+#
+# - corpus.pro is generated in the default mode and with --no-slice and
+#   --stream, which must not change the output, and the projects it lists
+#   are generated again as a -j batch read from a response file; all four
+#   runs are compared with golden/default. The default run also fails if
+#   it did more work than recorded in stats_baseline.json, by more than
+#   --max-regression percent. Work is measured by the counters that don't
+#   depend on the host, such as statements evaluated and variable reads,
+#   so the check is exact; timings of a corpus this small would only
+#   measure noise.
+# - spec/spec.pro is generated with the mkspec under corpus/mkspecs, Qt
+#   properties in `qmake -query` format and a baseline cache, and compared
+#   with golden/spec. The second run must reuse the cached baseline; a
+#   changed environment variable or a newly created optional feature must
+#   invalidate it.
+# - With --lib, capi/capi.pro is loaded through the C API of the qmake_eval
+#   library and its variables and warnings are compared with
+#   golden/capi/capi.txt, once on its own, after qmake_session_reset() and
+#   from several threads sharing a session.
+#
+# The corpus directory is written as @CORPUS@ in the output, with forward
+# slashes in the rest of such paths, so the golden files don't depend on
+# where the corpus was copied to or on the host's separator; project GUIDs
+# are derived from the project paths (--stable-guids).
+#
+# Usage: run_tests.py [--update] [--max-regression=<percent>] [--lib=<qmake_eval library>] <qmake_parser>
+#
+# --update rewrites the golden files and the stats baseline from the output
+# of the default, spec and C API runs instead of comparing; review the diff
+# before committing.
+#
+# The golden files must come from a build with the real parser generated
+# from qmake.y; regenerate them with --update whenever the grammar changes.
+
+import ctypes
+import difflib
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+CORPUS_DIR = os.path.join(TESTS_DIR, 'corpus')
+GOLDEN_DIR = os.path.join(TESTS_DIR, 'golden')
+STATS_BASELINE = os.path.join(TESTS_DIR, 'stats_baseline.json')
+
+MODES = [[], ['--no-slice'], ['--stream']]
+
+# The work counters are deterministic, so any increase is a regression.
+DEFAULT_MAX_REGRESSION = 0
+
+# Counters left out of the baseline; the tool skips them as well.
+HOST_DEPENDENT_STATS = ('translate_bytes', 'allocs', 'alloc_bytes')
+
+SPEC_ROOT = 'spec/spec.pro'
+SPEC_ARGS = ['--spec=mkspecs/win32-msvc2010', '--qt-props=mkspecs/qt_query.txt']
+SPEC_ENV_VAR = 'QMAKE_PARSER_TEST_VAR'
+
+CAPI_ROOT = 'capi/capi.pro'
+CAPI_THREADS = 4
+
+
+def list_files(root):
+    res = set()
+    for dirpath, _, filenames in os.walk(root):
+        for f in filenames:
+            res.add(os.path.relpath(os.path.join(dirpath, f), root).replace(os.sep, '/'))
+    return res
+
+
+def normalize(text, corpus):
+    for form in (corpus, corpus.replace('\\', '/'), corpus.replace('/', '\\')):
+        text = text.replace(form, '@CORPUS@')
+    text = re.sub(r'@CORPUS@[^;<>"\n]*', lambda m: m.group(0).replace('\\', '/'), text)
+    return text.replace('\r\n', '\n')
+
+
+def read_text(fname):
+    with open(fname, 'rb') as f:
+        return f.read().decode('utf-8')
+
+
+def write_text(fname, text):
+    os.makedirs(os.path.dirname(fname), exist_ok=True)
+    with open(fname, 'wb') as f:
+        f.write(text.encode('utf-8'))
+
+
+def corpus_roots():
+    """The projects corpus.pro lists, as the tool would resolve them."""
+    for line in read_text(os.path.join(CORPUS_DIR, 'corpus.pro')).splitlines():
+        if line.startswith('SUBDIRS'):
+            return ['%s/%s.pro' % (d, d) for d in line.split('=', 1)[1].split()]
+    return []
+
+
+def run_tool(tool, args, roots, workdir, fresh=True, env=None):
+    """Runs the tool on a copy of the corpus, a fresh one unless told
+    otherwise, and returns the files it generated as {relative path:
+    normalized text}, or None if it failed."""
+    corpus = os.path.join(workdir, 'corpus')
+    if fresh:
+        shutil.rmtree(corpus, ignore_errors=True)
+        shutil.copytree(CORPUS_DIR, corpus)
+
+    cmd = [tool, '--stable-guids'] + args + roots
+    proc = subprocess.run(cmd, cwd=corpus, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if proc.stdout:
+        sys.stdout.write(proc.stdout)
+    if proc.returncode != 0:
+        print('FAILED: %s (exit code %d)' % (' '.join(cmd), proc.returncode))
+        return None
+
+    generated = list_files(corpus) - list_files(CORPUS_DIR)
+    return {f: normalize(read_text(os.path.join(corpus, f)), corpus) for f in generated}
+
+
+def compare(generated, golden_name, label):
+    golden_dir = os.path.join(GOLDEN_DIR, golden_name)
+    golden = {f: read_text(os.path.join(golden_dir, f)) for f in list_files(golden_dir)}
+    ok = True
+    for f in sorted(set(golden) | set(generated)):
+        if f not in generated:
+            print('%s: not generated: %s' % (label, f))
+            ok = False
+        elif f not in golden:
+            print('%s: unexpected file: %s' % (label, f))
+            ok = False
+        elif golden[f] != generated[f].replace('\r\n', '\n'):
+            print('%s: differs: %s' % (label, f))
+            sys.stdout.writelines(difflib.unified_diff(
+                golden[f].splitlines(True), generated[f].splitlines(True), 'golden/%s/%s' % (golden_name, f), 'generated/' + f))
+            ok = False
+    if ok:
+        print('%s: %d files match' % (label, len(generated)))
+    return ok
+
+
+def write_golden(golden_name, generated):
+    golden_dir = os.path.join(GOLDEN_DIR, golden_name)
+    shutil.rmtree(golden_dir, ignore_errors=True)
+    for f, text in generated.items():
+        write_text(os.path.join(golden_dir, f), text)
+    print('Updated %d files in golden/%s' % (len(generated), golden_name))
+
+
+def spec_env(value):
+    env = dict(os.environ)
+    env[SPEC_ENV_VAR] = value
+    return env
+
+
+def file_id(fname):
+    st = os.stat(fname)
+    return (st.st_ino, st.st_mtime_ns, st.st_size)
+
+
+def run_spec(tool, workdir, update):
+    cache = os.path.join(workdir, 'baseline.cache')
+    args = SPEC_ARGS + ['--baseline-cache=' + cache]
+
+    generated = run_tool(tool, args, [SPEC_ROOT], workdir, env=spec_env('from_env'))
+    if generated is None:
+        return False
+    if update:
+        write_golden('spec', generated)
+        return True
+    ok = compare(generated, 'spec', 'spec')
+
+    # Same inputs: the baseline is read back instead of being rewritten.
+    written = file_id(cache)
+    generated = run_tool(tool, args, [SPEC_ROOT], workdir, fresh=False, env=spec_env('from_env'))
+    if generated is None or not compare(generated, 'spec', 'spec (cached baseline)'):
+        ok = False
+    elif file_id(cache) != written:
+        print('spec (cached baseline): the baseline cache was rewritten')
+        ok = False
+
+    # The mkspec reads the variable with $$(NAME).
+    generated = run_tool(tool, args, [SPEC_ROOT], workdir, fresh=False, env=spec_env('changed'))
+    if generated is None or 'ENV_changed' not in generated.get('spec/spec.vcxproj', ''):
+        print('spec (changed environment): the cached baseline was used')
+        ok = False
+
+    # The mkspec loads it with load(optional_feature, true).
+    write_text(os.path.join(workdir, 'corpus', 'mkspecs', 'features', 'optional_feature.prf'), 'DEFINES += FROM_OPTIONAL\n')
+    generated = run_tool(tool, args, [SPEC_ROOT], workdir, fresh=False, env=spec_env('changed'))
+    if generated is None or 'FROM_OPTIONAL' not in generated.get('spec/spec.vcxproj', ''):
+        print('spec (new optional feature): the cached baseline was used')
+        ok = False
+    return ok
+
+
+class EvalParams(ctypes.Structure):
+    _fields_ = [
+        ('config', ctypes.POINTER(ctypes.c_char_p)),
+        ('config_count', ctypes.c_size_t),
+        ('environment', ctypes.POINTER(ctypes.c_char_p)),
+        ('environment_count', ctypes.c_size_t),
+        ('inherit_environment', ctypes.c_int),
+        ('properties', ctypes.POINTER(ctypes.c_char_p)),
+        ('properties_count', ctypes.c_size_t),
+    ]
+
+
+def load_lib(path):
+    lib = ctypes.CDLL(path)
+    signatures = {
+        'qmake_session_create': (ctypes.c_void_p, []),
+        'qmake_session_destroy': (None, [ctypes.c_void_p]),
+        'qmake_session_reset': (None, [ctypes.c_void_p]),
+        'qmake_project_load': (ctypes.c_void_p, [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(EvalParams)]),
+        'qmake_project_free': (None, [ctypes.c_void_p]),
+        'qmake_project_error': (ctypes.c_char_p, [ctypes.c_void_p]),
+        'qmake_project_warning_count': (ctypes.c_size_t, [ctypes.c_void_p]),
+        'qmake_project_warning': (ctypes.c_char_p, [ctypes.c_void_p, ctypes.c_size_t]),
+        'qmake_project_var_count': (ctypes.c_size_t, [ctypes.c_void_p]),
+        'qmake_project_var_name': (ctypes.c_char_p, [ctypes.c_void_p, ctypes.c_size_t]),
+        'qmake_project_value_count': (ctypes.c_size_t, [ctypes.c_void_p, ctypes.c_char_p]),
+        'qmake_project_value': (ctypes.c_char_p, [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        fn = getattr(lib, name)
+        fn.restype = restype
+        fn.argtypes = argtypes
+    return lib
+
+
+def string_array(values):
+    return (ctypes.c_char_p * len(values))(*[v.encode('utf-8') for v in values]), len(values)
+
+
+def capi_params():
+    params = EvalParams()
+    params.config, params.config_count = string_array(['injected'])
+    params.environment, params.environment_count = string_array(['CAPI_VAR=from_params'])
+    params.inherit_environment = 0
+    params.properties, params.properties_count = string_array(['QT_INSTALL_HEADERS=C:/Qt/capi/include'])
+    return params
+
+
+def capi_dump(lib, session, root, params, corpus):
+    """Loads a project and returns its warnings and variables as text."""
+    project = lib.qmake_project_load(session, root.encode('utf-8'), ctypes.byref(params))
+    try:
+        lines = []
+        error = lib.qmake_project_error(project)
+        if error is not None:
+            lines.append('error: ' + error.decode('utf-8'))
+        for i in range(lib.qmake_project_warning_count(project)):
+            lines.append('warning: ' + lib.qmake_project_warning(project, i).decode('utf-8'))
+        for i in range(lib.qmake_project_var_count(project)):
+            name = lib.qmake_project_var_name(project, i)
+            values = [lib.qmake_project_value(project, name, j).decode('utf-8') for j in range(lib.qmake_project_value_count(project, name))]
+            lines.append('%s =%s' % (name.decode('utf-8'), ''.join(' [%s]' % v for v in values)))
+        return normalize('\n'.join(lines) + '\n', corpus)
+    finally:
+        lib.qmake_project_free(project)
+
+
+def without_warnings(text):
+    return ''.join(l for l in text.splitlines(True) if not l.startswith('warning: '))
+
+
+def run_capi(lib_path, workdir, update):
+    corpus = os.path.join(workdir, 'corpus')
+    shutil.rmtree(corpus, ignore_errors=True)
+    shutil.copytree(CORPUS_DIR, corpus)
+
+    lib = load_lib(lib_path)
+    params = capi_params()
+    root = os.path.join(corpus, CAPI_ROOT)
+    golden_file = os.path.join(GOLDEN_DIR, 'capi', 'capi.txt')
+
+    session = lib.qmake_session_create()
+    try:
+        dump = capi_dump(lib, session, root, params, corpus)
+        if update:
+            write_text(golden_file, dump)
+            print('Updated golden/capi/capi.txt')
+            return True
+
+        # Files parsed earlier in the session are parsed again, along with
+        # their warnings.
+        lib.qmake_session_reset(session)
+        reset_dump = capi_dump(lib, session, root, params, corpus)
+    finally:
+        lib.qmake_session_destroy(session)
+
+    # Warnings are reported by whichever thread parses a file first, so only
+    # the variables are compared.
+    session = lib.qmake_session_create()
+    threaded_dumps = [None] * CAPI_THREADS
+
+    def load(i):
+        threaded_dumps[i] = capi_dump(lib, session, root, params, corpus)
+
+    threads = [threading.Thread(target=load, args=(i,)) for i in range(CAPI_THREADS)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    lib.qmake_session_destroy(session)
+
+    golden = read_text(golden_file)
+    runs = [('capi', dump, golden), ('capi (after reset)', reset_dump, golden)]
+    for i, d in enumerate(threaded_dumps):
+        runs.append(('capi (thread %d)' % i, without_warnings(d), without_warnings(golden)))
+
+    ok = True
+    for label, text, expected in runs:
+        if text != expected:
+            print('%s: differs from golden/capi/capi.txt' % label)
+            sys.stdout.writelines(difflib.unified_diff(expected.splitlines(True), text.splitlines(True), 'golden/capi/capi.txt', 'loaded'))
+            ok = False
+    if ok:
+        print('capi: %d loads match' % len(runs))
+    return ok
+
+
+def update(tool, lib, workdir):
+    stats = os.path.join(workdir, 'stats.json')
+    generated = run_tool(tool, ['--stats=' + stats], ['corpus.pro'], workdir)
+    if generated is None:
+        return False
+    write_golden('default', generated)
+
+    with open(stats) as f:
+        run = json.load(f)['run']
+    run = {k: v for k, v in run.items() if not k.endswith('_us') and k not in HOST_DEPENDENT_STATS}
+    write_text(STATS_BASELINE, json.dumps({'run': run}, indent=2) + '\n')
+    print('Updated %s' % os.path.basename(STATS_BASELINE))
+
+    if not run_spec(tool, workdir, True):
+        return False
+    if lib is not None and not run_capi(lib, workdir, True):
+        return False
+    return True
+
+
+def main(argv):
+    update_golden = False
+    max_regression = DEFAULT_MAX_REGRESSION
+    lib = None
+    tool = None
+    for arg in argv[1:]:
+        if arg == '--update':
+            update_golden = True
+        elif arg.startswith('--max-regression='):
+            max_regression = float(arg[len('--max-regression='):])
+        elif arg.startswith('--lib='):
+            lib = os.path.abspath(arg[len('--lib='):])
+        elif tool is None and not arg.startswith('-'):
+            tool = os.path.abspath(arg)
+        else:
+            tool = None
+            break
+
+    if tool is None:
+        print('Usage: %s [--update] [--max-regression=<percent>] [--lib=<qmake_eval library>] <qmake_parser>' % os.path.basename(argv[0]))
+        return 2
+
+    workdir = tempfile.mkdtemp(prefix='qmake_parser_tests_')
+    try:
+        if update_golden:
+            return 0 if update(tool, lib, workdir) else 1
+
+        ok = True
+        for mode in MODES:
+            args = list(mode)
+            if not mode:
+                args += ['--stats-baseline=' + STATS_BASELINE, '--max-regression=%g' % max_regression]
+            generated = run_tool(tool, args, ['corpus.pro'], workdir)
+            if generated is None or not compare(generated, 'default', ' '.join(mode) or 'default'):
+                ok = False
+
+        response_file = os.path.join(workdir, 'roots.txt')
+        write_text(response_file, '# Every project of corpus.pro as a root\n' + '\n'.join(corpus_roots()) + '\n')
+        generated = run_tool(tool, ['-j', '4'], ['@' + response_file], workdir)
+        if generated is None or not compare(generated, 'default', '-j 4 batch'):
+            ok = False
+
+        if not run_spec(tool, workdir, False):
+            ok = False
+
+        if lib is None:
+            print('capi: skipped, no --lib given')
+        elif not run_capi(lib, workdir, False):
+            ok = False
+        return 0 if ok else 1
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
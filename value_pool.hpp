@@ -0,0 +1,129 @@
+#ifndef VALUE_POOL_HPP
+#define VALUE_POOL_HPP
+
+#include <boost/functional/hash.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<std::string> value_list;
+typedef std::shared_ptr<value_list> value_ref;
+
+// A process-wide hash-consing table for variable values.
+//
+// Environments keep their values behind shared pointers and hand them
+// to the pool once a project has been evaluated. Identical lists then end
+// up as a single allocation shared by all projects, and two interned lists
+// are equal if and only if they are the same pointer.
+//
+// The pool only refers to the lists weakly; an interned list leaves the
+// table when the last environment using it is destroyed, so the pool
+// never keeps values alive on its own.
+//
+// Interned lists and lists with more than one owner must never be
+// modified in place; env_t copies them first.
+class value_pool
+{
+public:
+	static value_pool & instance()
+	{
+		// Never destroyed, so that lists released during static
+		// destruction can still unregister themselves.
+		static value_pool * pool = new value_pool();
+		return *pool;
+	}
+
+	// The caller must replace `v` with the result; its values may have
+	// been moved to the pooled copy.
+	value_ref intern(value_ref const & v)
+	{
+		size_t h = boost::hash_range(v->begin(), v->end());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto range = m_lists.equal_range(h);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.list == v.get())
+				return v;
+
+			// Listed lists are alive while the lock is held: the releaser
+			// unregisters a list before deleting it. A reference is only
+			// taken to the list returned, as dropping the last reference here
+			// would run the releaser under the lock. Lists whose last owner
+			// is being destroyed right now are skipped.
+			if (*it->second.list == *v)
+			{
+				if (value_ref existing = it->second.ref.lock())
+					return existing;
+			}
+		}
+
+		// The pooled copy unregisters itself when it is released. The
+		// original may be shared with another environment, in which case
+		// its values are copied rather than moved.
+		value_list * list = v.use_count() == 1? new value_list(std::move(*v)): new value_list(*v);
+		value_ref res(list, releaser(this, h));
+
+		entry e;
+		e.list = list;
+		e.ref = res;
+		m_lists.insert(std::make_pair(h, e));
+		return res;
+	}
+
+	static bool is_interned(value_ref const & v)
+	{
+		return std::get_deleter<releaser>(v) != nullptr;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_lists.size();
+	}
+
+private:
+	struct entry
+	{
+		value_list const * list;
+		std::weak_ptr<value_list> ref;
+	};
+
+	struct releaser
+	{
+		releaser(value_pool * pool, size_t hash)
+			: pool(pool), hash(hash)
+		{
+		}
+
+		void operator()(value_list * list) const
+		{
+			pool->release(list, hash);
+			delete list;
+		}
+
+		value_pool * pool;
+		size_t hash;
+	};
+
+	void release(value_list const * list, size_t hash)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto range = m_lists.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.list == list)
+			{
+				m_lists.erase(it);
+				return;
+			}
+		}
+	}
+
+	mutable std::mutex m_mutex;
+	std::unordered_multimap<size_t, entry> m_lists;
+};
+
+#endif // VALUE_POOL_HPP
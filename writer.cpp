@@ -0,0 +1,126 @@
+#include "writer.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <stdexcept>
+namespace fs = boost::filesystem;
+
+file_writer_pool::file_writer_pool(size_t threads, size_t max_pending)
+	: m_max_pending(max_pending), m_active(0), m_stopping(false)
+{
+	for (size_t i = 0; i < threads; ++i)
+		m_threads.push_back(std::thread(&file_writer_pool::run, this));
+}
+
+file_writer_pool::~file_writer_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_not_empty.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); ++i)
+		m_threads[i].join();
+}
+
+void file_writer_pool::write(std::string const & path, std::string content)
+{
+	job j;
+	j.path = path;
+	j.content.swap(content);
+
+	if (m_threads.empty())
+	{
+		write_atomically(j);
+		if (m_written)
+			m_written(j.path);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_jobs.size() >= m_max_pending)
+		m_not_full.wait(lock);
+	m_jobs.push_back(std::move(j));
+	m_not_empty.notify_one();
+}
+
+void file_writer_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_jobs.empty() || m_active != 0)
+		m_idle.wait(lock);
+
+	if (!m_errors.empty())
+	{
+		std::string msg = m_errors.front();
+		m_errors.clear();
+		throw std::runtime_error(msg);
+	}
+}
+
+void file_writer_pool::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		while (m_jobs.empty() && !m_stopping)
+			m_not_empty.wait(lock);
+
+		// Drain the queue even when stopping; queued files must not be lost.
+		if (m_jobs.empty())
+			return;
+
+		job j = std::move(m_jobs.front());
+		m_jobs.pop_front();
+		++m_active;
+		m_not_full.notify_one();
+
+		lock.unlock();
+		std::string error;
+		try
+		{
+			write_atomically(j);
+			if (m_written)
+				m_written(j.path);
+		}
+		catch (std::exception const & e)
+		{
+			error = e.what();
+		}
+		lock.lock();
+
+		if (!error.empty())
+			m_errors.push_back(error);
+		--m_active;
+		if (m_jobs.empty() && m_active == 0)
+			m_idle.notify_all();
+	}
+}
+
+// Atomic with respect to other processes and to crashes of this one; the
+// data is left in the OS cache, see the class comment.
+void file_writer_pool::write_atomically(job const & j)
+{
+	fs::path tmp = j.path;
+	tmp += fs::unique_path(".%%%%%%%%.tmp");
+
+	{
+		std::ofstream fout(tmp.string().c_str());
+		fout.write(j.content.data(), j.content.size());
+		fout.close();
+		if (!fout)
+		{
+			boost::system::error_code ec;
+			fs::remove(tmp, ec);
+			throw std::runtime_error("Failed to write " + j.path);
+		}
+	}
+
+	boost::system::error_code ec;
+	fs::rename(tmp, j.path, ec);
+	if (ec)
+	{
+		fs::remove(tmp, ec);
+		throw std::runtime_error("Failed to replace " + j.path);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef WRITER_HPP
+#define WRITER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes generated files on background threads so that evaluation of the
+// next project can overlap with disk I/O.
+//
+// Each file is written to a temporary file next to its destination and
+// then renamed over it, so a crash of the tool never leaves a truncated
+// project behind. Nothing is flushed to disk, though: after a power loss
+// a file may still be empty or stale. Generated files can always be
+// regenerated, and syncing each of them would dominate the run time.
+// The queue is bounded; `write` blocks while it is full.
+class file_writer_pool
+{
+public:
+	explicit file_writer_pool(size_t threads = 2, size_t max_pending = 16);
+	~file_writer_pool();
+
+	void write(std::string const & path, std::string content);
+
+	// Called with the path of every file written, on the thread that wrote
+	// it. Must be set before the first write.
+	void on_written(std::function<void (std::string const & path)> fn) { m_written = fn; }
+
+	// Blocks until every queued file is written. Throws if any of the
+	// writes failed.
+	void wait();
+
+private:
+	struct job
+	{
+		std::string path;
+		std::string content;
+	};
+
+	void run();
+	static void write_atomically(job const & j);
+
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::condition_variable m_idle;
+	std::deque<job> m_jobs;
+	size_t m_max_pending;
+	size_t m_active;
+	bool m_stopping;
+	std::function<void (std::string const & path)> m_written;
+	std::vector<std::string> m_errors;
+	std::vector<std::thread> m_threads;
+};
+
+#endif // WRITER_HPP